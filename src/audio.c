@@ -1,8 +1,11 @@
 #include "audio.h"
 
+#include <math.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #ifdef __APPLE__
 #include <OpenAL/al.h>
@@ -12,30 +15,145 @@
 #include <AL/alc.h>
 #endif
 
+#ifndef __EMSCRIPTEN__
+#include <pthread.h>
+#endif
+
 #include "contrib/minimp3_ex.h"
 
+#include "clock.h"
 #include "error.h"
 #include "constants.h"
+#include "trace.h"
 
+// Buffers queued on the source at once
 #define NUM_BUFFERS 4
-#define BUFFER_SIZE (4096 * 4)
+// Samples (counting every channel) decoded at a time and held by every buffer, ~93ms of stereo at 44.1kHz
+#define CHUNK_SAMPLES (4096 * 2)
+// Chunks decoded ahead of what's queued on the source, ~3s of stereo at 44.1kHz
+#define RING_CHUNKS 32
+// How often the streamer checks on the source while it plays. Otherwise both threads sleep until woken up
+#define STREAM_POLL_MS 5
+// How quickly the position reported catches up with the one measured, in seconds
+#define POSITION_SMOOTHING_SECONDS 0.05
+// Past this many seconds apart, the position reported jumps straight to the one measured
+#define POSITION_SNAP_SECONDS 0.1
+
+// From AL_SOFT_source_latency, which isn't in every set of headers: the sample offset in 32.32 fixed point along with how
+// many nanoseconds it takes for it to be heard
+#define AL_SAMPLE_OFFSET_LATENCY_SOFT_ 0x1200
+typedef void (*GetSourcei64vFunc_t)(ALuint source, ALenum param, int64_t *values);
+
+/**
+ * Decoded PCM on its way from the decoder to the source
+ */
+typedef struct PcmChunk_t {
+    // Seek the chunk was decoded after. Chunks from before the latest seek are dropped
+    uint32_t generation;
+    // Sample (counting every channel) of the song the chunk starts at
+    uint64_t first_sample;
+    int32_t num_samples;
+    // Set on the empty chunk that follows the last one of the song
+    bool end;
+    int16_t pcm[CHUNK_SAMPLES];
+} PcmChunk_t;
+
+/**
+ * Single producer (the decoder), single consumer (the streamer) ring of chunks. Each side only ever moves its own index, so
+ * nothing is locked
+ */
+typedef struct PcmRing_t {
+    PcmChunk_t chunks[RING_CHUNKS];
+    // Chunks written and read so far, the difference being how many are waiting
+    atomic_size_t written, read;
+} PcmRing_t;
+
+/**
+ * Turns the MP3 into chunks for the ring
+ */
+typedef struct Decoder_t {
+    mp3dec_ex_t mp3;
+    uint32_t generation;
+    bool reached_end;
+} Decoder_t;
+
+/**
+ * Queues chunks from the ring on the source as its buffers free up
+ */
+typedef struct Streamer_t {
+    uint32_t generation;
+    bool playing;
+    bool reached_end;
+    // Buffers queued on the source in the order they play, along with the sample each one starts at
+    ALuint queued[NUM_BUFFERS];
+    uint64_t queued_first_sample[NUM_BUFFERS];
+    int32_t num_queued;
+    // Buffers that aren't queued
+    ALuint free[NUM_BUFFERS];
+    int32_t num_free;
+    // Sample the source is at once everything queued plays
+    uint64_t end_sample;
+} Streamer_t;
+
+#ifndef __EMSCRIPTEN__
+/**
+ * Lets a streaming thread sleep until there's something for it to do. A wakeup sent while it's busy isn't lost, the next wait
+ * returns right away instead
+ */
+typedef struct Wakeup_t {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    bool pending;
+} Wakeup_t;
+#endif
 
 typedef struct {
     uint8_t *mp3_data;
     size_t mp3_size;
-    mp3dec_ex_t decoder;
     ALCdevice *device;
     ALCcontext *context;
     ALuint source;
     ALuint buffers[NUM_BUFFERS];
-    int16_t pcm_buffer[BUFFER_SIZE];
     int channels;
     int sample_rate;
     double total_time;
     uint64_t total_samples;
-    uint64_t last_first_decoded_sample;
+    // Whether playing was asked for, which only the main thread changes
     bool paused;
-    bool stopped;
+    // Without an audio device, the position in the song is kept here instead
+    bool silent;
+    double silent_position;
+    bool silent_stopped;
+
+    // Commands from the main thread. A seek sets seek_sample and then bumps generation, after which the decoder and the
+    // streamer start over from there the next time they look
+    atomic_uint generation;
+    atomic_uint_fast64_t seek_sample;
+    atomic_bool play;
+    // Published by the streamer under position_sequence (odd while being written): the sample being heard, when it was
+    // measured, whether it's moving and the generation it belongs to. Also the last generation played all the way to the end
+    atomic_uint position_sequence;
+    atomic_uint_fast64_t position_sample;
+    _Atomic double position_measured_time;
+    atomic_bool position_playing;
+    atomic_uint position_generation;
+    atomic_uint ended_generation;
+    // Where the position reported by audio_elapsed_time was and at which frame time, which only the main thread touches
+    double smooth_position;
+    double smooth_time;
+    uint32_t smooth_generation;
+    bool smooth_valid;
+    MAYBE_NULL GetSourcei64vFunc_t get_source_i64v;
+
+    // Each only touched by the thread running it (or by audio_loop where there are no threads)
+    Decoder_t decoder;
+    Streamer_t streamer;
+    OWNING PcmRing_t *ring;
+#ifndef __EMSCRIPTEN__
+    pthread_t decode_thread, stream_thread;
+    atomic_bool threads_running;
+    Wakeup_t decoder_wakeup, streamer_wakeup;
+#endif
 } audio_state_t;
 
 static audio_state_t g_audio = {0};
@@ -47,7 +165,313 @@ static void check_al_error(const char *msg) {
     }
 }
 
-void audio_init(void) {
+#ifndef __EMSCRIPTEN__
+static void wakeup_init(Wakeup_t *wakeup) {
+    pthread_mutex_init(&wakeup->mutex, NULL);
+    pthread_cond_init(&wakeup->cond, NULL);
+    wakeup->pending = false;
+}
+
+static void wakeup_destroy(Wakeup_t *wakeup) {
+    pthread_cond_destroy(&wakeup->cond);
+    pthread_mutex_destroy(&wakeup->mutex);
+}
+
+static void wakeup_signal(Wakeup_t *wakeup) {
+    pthread_mutex_lock(&wakeup->mutex);
+    wakeup->pending = true;
+    pthread_cond_signal(&wakeup->cond);
+    pthread_mutex_unlock(&wakeup->mutex);
+}
+
+/**
+ * Sleeps until woken up, or for at most timeout_ms if it isn't negative
+ */
+static void wakeup_wait(Wakeup_t *wakeup, const int32_t timeout_ms) {
+    struct timespec deadline;
+    if ( timeout_ms >= 0 ) {
+        // Condition variables time out against the realtime clock
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += (long)timeout_ms * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+    }
+
+    pthread_mutex_lock(&wakeup->mutex);
+    while ( !wakeup->pending ) {
+        if ( timeout_ms < 0 ) {
+            pthread_cond_wait(&wakeup->cond, &wakeup->mutex);
+        } else if ( pthread_cond_timedwait(&wakeup->cond, &wakeup->mutex, &deadline) != 0 ) {
+            break;
+        }
+    }
+    wakeup->pending = false;
+    pthread_mutex_unlock(&wakeup->mutex);
+}
+#endif
+
+static void wake_decoder(void) {
+#ifndef __EMSCRIPTEN__
+    wakeup_signal(&g_audio.decoder_wakeup);
+#endif
+}
+
+static void wake_streamer(void) {
+#ifndef __EMSCRIPTEN__
+    wakeup_signal(&g_audio.streamer_wakeup);
+#endif
+}
+
+static uint64_t time_to_sample(const double time) {
+    const uint64_t channels = (uint64_t)MAX(g_audio.channels, 1);
+    const uint64_t sample = (uint64_t)(MAX(0.0, time) * (double)g_audio.sample_rate * (double)channels);
+    // Always start on the first channel
+    return MIN(sample - sample % channels, g_audio.total_samples);
+}
+
+static double sample_to_time(const uint64_t sample) {
+    return (double)sample / (double)g_audio.sample_rate / (double)g_audio.channels;
+}
+
+/**
+ * Decodes up to max_chunks into the ring, stopping early if it fills up or the song ends.
+ * Returns false if there was nothing to decode
+ */
+static bool decode_step(const int32_t max_chunks) {
+    Decoder_t *decoder = &g_audio.decoder;
+    PcmRing_t *ring = g_audio.ring;
+    const bool seeked = atomic_load_explicit(&g_audio.generation, memory_order_acquire) != decoder->generation;
+    const size_t waiting =
+        atomic_load_explicit(&ring->written, memory_order_relaxed) - atomic_load_explicit(&ring->read, memory_order_acquire);
+    if ( !seeked && (decoder->reached_end || waiting == RING_CHUNKS) ) {
+        return false;
+    }
+    TRACE_BEGIN("audio_decode");
+
+    int32_t num_decoded = 0;
+    for ( int32_t i = 0; i < max_chunks; i++ ) {
+        const uint32_t generation = atomic_load_explicit(&g_audio.generation, memory_order_acquire);
+        if ( generation != decoder->generation ) {
+            mp3dec_ex_seek(&decoder->mp3, atomic_load_explicit(&g_audio.seek_sample, memory_order_relaxed));
+            decoder->generation = generation;
+            decoder->reached_end = false;
+        }
+
+        const size_t written = atomic_load_explicit(&ring->written, memory_order_relaxed);
+        if ( decoder->reached_end || written - atomic_load_explicit(&ring->read, memory_order_acquire) == RING_CHUNKS ) {
+            break;
+        }
+
+        PcmChunk_t *chunk = &ring->chunks[written % RING_CHUNKS];
+        chunk->generation = generation;
+        chunk->first_sample = decoder->mp3.cur_sample;
+        chunk->num_samples = (int32_t)mp3dec_ex_read(&decoder->mp3, chunk->pcm, CHUNK_SAMPLES);
+        chunk->end = chunk->num_samples == 0;
+        decoder->reached_end = chunk->end;
+        atomic_store_explicit(&ring->written, written + 1, memory_order_release);
+        num_decoded++;
+    }
+
+    if ( num_decoded > 0 ) {
+        wake_streamer();
+    }
+    TRACE_END();
+    return true;
+}
+
+static void unqueue_buffers(Streamer_t *streamer, const int32_t count) {
+    // Buffers come off the source in the order they were queued
+    alSourceUnqueueBuffers(g_audio.source, count, streamer->queued);
+    check_al_error("alSourceUnqueueBuffers");
+    for ( int32_t i = 0; i < count; i++ ) {
+        streamer->free[streamer->num_free++] = streamer->queued[i];
+    }
+
+    streamer->num_queued -= count;
+    memmove(streamer->queued, streamer->queued + count, sizeof(*streamer->queued) * streamer->num_queued);
+    memmove(streamer->queued_first_sample, streamer->queued_first_sample + count,
+            sizeof(*streamer->queued_first_sample) * streamer->num_queued);
+}
+
+/**
+ * Measures the sample being heard right now: how far the source is into the oldest buffer still queued, minus however long
+ * the device takes to play it when it can tell
+ */
+static uint64_t measure_position(const Streamer_t *streamer, bool *playing) {
+    *playing = false;
+    if ( streamer->num_queued == 0 ) {
+        return streamer->end_sample;
+    }
+
+    ALint state;
+    alGetSourcei(g_audio.source, AL_SOURCE_STATE, &state);
+    *playing = state == AL_PLAYING;
+
+    // Offsets count from the start of the oldest buffer in the queue, processed or not, which is the one unqueued last
+    double frames;
+    if ( g_audio.get_source_i64v != NULL ) {
+        int64_t values[2] = {0};
+        g_audio.get_source_i64v(g_audio.source, AL_SAMPLE_OFFSET_LATENCY_SOFT_, values);
+        frames = (double)values[0] / 4294967296.0 - (double)values[1] / 1e9 * g_audio.sample_rate;
+    } else {
+        ALint offset = 0;
+        alGetSourcei(g_audio.source, AL_SAMPLE_OFFSET, &offset);
+        frames = offset;
+    }
+
+    const uint64_t sample = streamer->queued_first_sample[0] + (uint64_t)MAX(0.0, frames) * (uint64_t)g_audio.channels;
+    return MIN(sample, streamer->end_sample);
+}
+
+static void publish_position(const Streamer_t *streamer) {
+    bool playing;
+    const uint64_t sample = measure_position(streamer, &playing);
+    const double measured_time = clock_system_time();
+
+    const uint32_t sequence = atomic_load_explicit(&g_audio.position_sequence, memory_order_relaxed);
+    atomic_store_explicit(&g_audio.position_sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&g_audio.position_sample, sample, memory_order_relaxed);
+    atomic_store_explicit(&g_audio.position_measured_time, measured_time, memory_order_relaxed);
+    atomic_store_explicit(&g_audio.position_playing, playing, memory_order_relaxed);
+    atomic_store_explicit(&g_audio.position_generation, streamer->generation, memory_order_relaxed);
+    atomic_store_explicit(&g_audio.position_sequence, sequence + 2, memory_order_release);
+}
+
+/**
+ * Follows the commands of the main thread, keeps the source fed with chunks from the ring and publishes where it is.
+ * Returns whether the source is playing through its buffers, which have to be checked on every so often until it stops
+ */
+static bool stream_step(void) {
+    Streamer_t *streamer = &g_audio.streamer;
+    PcmRing_t *ring = g_audio.ring;
+    const uint32_t generation = atomic_load_explicit(&g_audio.generation, memory_order_acquire);
+    const bool play = atomic_load_explicit(&g_audio.play, memory_order_acquire);
+    ALint processed = 0;
+    alGetSourcei(g_audio.source, AL_BUFFERS_PROCESSED, &processed);
+
+    size_t read = atomic_load_explicit(&ring->read, memory_order_relaxed);
+    const bool has_chunks = read != atomic_load_explicit(&ring->written, memory_order_acquire);
+    const bool busy = generation != streamer->generation || play != streamer->playing || processed > 0 ||
+                      (has_chunks && streamer->num_free > 0);
+    if ( busy ) {
+        TRACE_BEGIN("audio_stream");
+
+        if ( generation != streamer->generation ) {
+            // Whatever is queued is from before the seek
+            alSourceStop(g_audio.source);
+            unqueue_buffers(streamer, streamer->num_queued);
+            streamer->playing = false;
+            streamer->reached_end = false;
+            streamer->end_sample = atomic_load_explicit(&g_audio.seek_sample, memory_order_relaxed);
+            streamer->generation = generation;
+        } else if ( processed > 0 ) {
+            unqueue_buffers(streamer, processed);
+        }
+
+        const ALenum format = g_audio.channels == 2 ? AL_FORMAT_STEREO16 : AL_FORMAT_MONO16;
+        const size_t first_read = read;
+        while ( streamer->num_free > 0 && read != atomic_load_explicit(&ring->written, memory_order_acquire) ) {
+            const PcmChunk_t *chunk = &ring->chunks[read % RING_CHUNKS];
+            // Chunks from before the latest seek are skipped
+            if ( chunk->generation == generation && chunk->end ) {
+                streamer->reached_end = true;
+            } else if ( chunk->generation == generation ) {
+                const ALuint buffer = streamer->free[--streamer->num_free];
+                alBufferData(buffer, format, chunk->pcm, (ALsizei)(chunk->num_samples * sizeof(int16_t)),
+                             g_audio.sample_rate);
+                check_al_error("alBufferData");
+                alSourceQueueBuffers(g_audio.source, 1, &buffer);
+                check_al_error("alSourceQueueBuffers");
+                streamer->queued[streamer->num_queued] = buffer;
+                streamer->queued_first_sample[streamer->num_queued] = chunk->first_sample;
+                streamer->num_queued++;
+                streamer->end_sample = chunk->first_sample + chunk->num_samples;
+            }
+            atomic_store_explicit(&ring->read, ++read, memory_order_release);
+        }
+        if ( read != first_read ) {
+            // Room for more
+            wake_decoder();
+        }
+
+        if ( play && streamer->num_queued > 0 ) {
+            ALint state;
+            alGetSourcei(g_audio.source, AL_SOURCE_STATE, &state);
+            // Also restarts it if it ever ran out of buffers before they were refilled
+            if ( state != AL_PLAYING ) {
+                alSourcePlay(g_audio.source);
+                check_al_error("alSourcePlay");
+            }
+            streamer->playing = true;
+        } else if ( !play && streamer->playing ) {
+            alSourcePause(g_audio.source);
+            streamer->playing = false;
+        }
+
+        TRACE_END();
+    }
+
+    publish_position(streamer);
+    if ( streamer->reached_end && streamer->num_queued == 0 ) {
+        atomic_store_explicit(&g_audio.ended_generation, generation, memory_order_release);
+    }
+    return streamer->playing && streamer->num_queued > 0;
+}
+
+#ifndef __EMSCRIPTEN__
+static void *decode_thread_main(void *) {
+    trace_set_thread_name("audio decoder");
+    while ( atomic_load(&g_audio.threads_running) ) {
+        // Woken up once the streamer makes room in the ring, or on a seek
+        if ( !decode_step(RING_CHUNKS) ) {
+            wakeup_wait(&g_audio.decoder_wakeup, -1);
+        }
+    }
+    return NULL;
+}
+
+static void *stream_thread_main(void *) {
+    trace_set_thread_name("audio streamer");
+    while ( atomic_load(&g_audio.threads_running) ) {
+        // OpenAL can't tell when a buffer finishes, so that's polled for. Anything else wakes it up
+        const bool playing = stream_step();
+        wakeup_wait(&g_audio.streamer_wakeup, playing ? STREAM_POLL_MS : -1);
+    }
+    return NULL;
+}
+#endif
+
+/**
+ * Starts decoding and streaming the loaded song on threads of their own, where there are threads
+ */
+static void start_streaming(void) {
+#ifndef __EMSCRIPTEN__
+    atomic_store(&g_audio.threads_running, true);
+    if ( pthread_create(&g_audio.decode_thread, NULL, decode_thread_main, NULL) != 0 ||
+         pthread_create(&g_audio.stream_thread, NULL, stream_thread_main, NULL) != 0 ) {
+        error_abort("Failed to start the audio threads");
+    }
+#endif
+}
+
+static void stop_streaming(void) {
+#ifndef __EMSCRIPTEN__
+    if ( atomic_exchange(&g_audio.threads_running, false) ) {
+        wake_decoder();
+        wake_streamer();
+        pthread_join(g_audio.decode_thread, NULL);
+        pthread_join(g_audio.stream_thread, NULL);
+    }
+#endif
+}
+
+void audio_init(const bool silent) {
+    g_audio.silent = silent;
+    if ( silent ) {
+        return;
+    }
+
     g_audio.device = alcOpenDevice(NULL);
     if ( !g_audio.device ) {
         error_abort("Failed to open OpenAL device");
@@ -65,45 +489,70 @@ void audio_init(void) {
     alGenSources(1, &g_audio.source);
     alGenBuffers(NUM_BUFFERS, g_audio.buffers);
     check_al_error("init");
-}
 
-void audio_finish(void) {
-    alDeleteSources(1, &g_audio.source);
-    alDeleteBuffers(NUM_BUFFERS, g_audio.buffers);
+    if ( alIsExtensionPresent("AL_SOFT_source_latency") ) {
+        // Function pointers can't be cast from the object pointer it's returned as
+        void *proc = alGetProcAddress("alGetSourcei64vSOFT");
+        memcpy(&g_audio.get_source_i64v, &proc, sizeof(proc));
+    }
 
-    alcMakeContextCurrent(NULL);
-    alcDestroyContext(g_audio.context);
-    alcCloseDevice(g_audio.device);
+    g_audio.ring = calloc(1, sizeof(*g_audio.ring));
+    if ( g_audio.ring == NULL ) {
+        error_abort("Failed to allocate the audio ring");
+    }
+#ifndef __EMSCRIPTEN__
+    wakeup_init(&g_audio.decoder_wakeup);
+    wakeup_init(&g_audio.streamer_wakeup);
+#endif
+}
 
+static void close_song(void) {
     if ( g_audio.mp3_data != NULL ) {
-        mp3dec_ex_close(&g_audio.decoder);
+        mp3dec_ex_close(&g_audio.decoder.mp3);
         free(g_audio.mp3_data);
         g_audio.mp3_data = NULL;
     }
 }
 
-static void reset(void) {
-    audio_resume();
-    audio_pause();
-}
+void audio_finish(void) {
+    if ( !g_audio.silent ) {
+        stop_streaming();
+        alDeleteSources(1, &g_audio.source);
+        alDeleteBuffers(NUM_BUFFERS, g_audio.buffers);
+
+        alcMakeContextCurrent(NULL);
+        alcDestroyContext(g_audio.context);
+        alcCloseDevice(g_audio.device);
+        free(g_audio.ring);
+        g_audio.ring = NULL;
+#ifndef __EMSCRIPTEN__
+        wakeup_destroy(&g_audio.decoder_wakeup);
+        wakeup_destroy(&g_audio.streamer_wakeup);
+#endif
+    }
 
-void audio_load(const unsigned char *data, const int data_size) {
-    alSourceStop(g_audio.source);
+    close_song();
+}
 
-    // Clear queued buffers
-    ALint queued;
-    alGetSourcei(g_audio.source, AL_BUFFERS_QUEUED, &queued);
-    while ( queued > 0 ) {
-        ALuint buffer;
-        alSourceUnqueueBuffers(g_audio.source, 1, &buffer);
-        queued--;
-    }
+/**
+ * Asks the decoder and the streamer to start over from the given sample
+ */
+static void request_seek(const uint64_t sample) {
+    atomic_store_explicit(&g_audio.seek_sample, sample, memory_order_relaxed);
+    atomic_fetch_add_explicit(&g_audio.generation, 1, memory_order_release);
+    wake_decoder();
+    wake_streamer();
+}
 
-    if ( g_audio.mp3_data != NULL ) {
-        mp3dec_ex_close(&g_audio.decoder);
-        free(g_audio.mp3_data);
-        g_audio.mp3_data = NULL;
+void audio_load(const unsigned char *data, const int data_size) {
+    if ( !g_audio.silent ) {
+        stop_streaming();
+        alSourceStop(g_audio.source);
+        // Clear queued buffers
+        alSourcei(g_audio.source, AL_BUFFER, 0);
+        check_al_error("audio_load");
     }
+    close_song();
 
     g_audio.mp3_data = malloc(data_size);
     if ( g_audio.mp3_data == NULL ) {
@@ -112,43 +561,67 @@ void audio_load(const unsigned char *data, const int data_size) {
     memcpy(g_audio.mp3_data, data, data_size);
     g_audio.mp3_size = data_size;
 
-    if ( mp3dec_ex_open_buf(&g_audio.decoder, g_audio.mp3_data, g_audio.mp3_size, MP3D_SEEK_TO_SAMPLE) != 0 ) {
+    mp3dec_ex_t *mp3 = &g_audio.decoder.mp3;
+    if ( mp3dec_ex_open_buf(mp3, g_audio.mp3_data, g_audio.mp3_size, MP3D_SEEK_TO_SAMPLE) != 0 ) {
         free(g_audio.mp3_data);
         g_audio.mp3_data = NULL;
         error_abort("Failed to initialize MP3 decoder");
     }
 
-    g_audio.channels = g_audio.decoder.info.channels;
-    g_audio.sample_rate = g_audio.decoder.info.hz;
-    g_audio.total_samples = g_audio.decoder.samples;
-    g_audio.total_time = (double)g_audio.total_samples / (double)g_audio.sample_rate / (double)g_audio.channels;
+    g_audio.channels = mp3->info.channels;
+    g_audio.sample_rate = mp3->info.hz;
+    g_audio.total_samples = mp3->samples;
+    g_audio.total_time = sample_to_time(g_audio.total_samples);
+    g_audio.paused = true;
 
-    // Preload buffers
-    for ( int i = 0; i < NUM_BUFFERS; i++ ) {
-        const size_t read = mp3dec_ex_read(&g_audio.decoder, g_audio.pcm_buffer, BUFFER_SIZE / sizeof(int16_t));
-        if ( read > 0 ) {
-            alBufferData(g_audio.buffers[i], g_audio.channels == 2 ? AL_FORMAT_STEREO16 : AL_FORMAT_MONO16, g_audio.pcm_buffer,
-                         (ALsizei)(read * sizeof(int16_t)), g_audio.sample_rate);
-            alSourceQueueBuffers(g_audio.source, 1, &g_audio.buffers[i]);
-        }
+    if ( g_audio.silent ) {
+        g_audio.silent_position = 0.0;
+        g_audio.silent_stopped = false;
+        return;
     }
 
-    reset();
+    // Start from scratch, with every buffer free and nothing in the ring
+    atomic_store(&g_audio.play, false);
+    const uint32_t generation = atomic_load(&g_audio.generation);
+    g_audio.streamer = (Streamer_t){.generation = generation, .num_free = NUM_BUFFERS};
+    memcpy(g_audio.streamer.free, g_audio.buffers, sizeof(g_audio.buffers));
+    g_audio.decoder.generation = generation;
+    atomic_store(&g_audio.ring->written, 0);
+    atomic_store(&g_audio.ring->read, 0);
+    request_seek(0);
+    start_streaming();
+}
+
+/**
+ * Whether the song played all the way to the end since the last seek
+ */
+static bool has_ended(void) {
+    if ( g_audio.silent ) {
+        return g_audio.silent_stopped;
+    }
+    return atomic_load_explicit(&g_audio.ended_generation, memory_order_acquire) ==
+           atomic_load_explicit(&g_audio.generation, memory_order_acquire);
 }
 
 void audio_resume(void) {
-    if ( g_audio.stopped ) {
-        mp3dec_ex_seek(&g_audio.decoder, 0);
-        g_audio.stopped = false;
-        g_audio.paused = false;
-        alSourcePlay(g_audio.source);
-    } else if ( g_audio.paused ) {
-        if ( audio_elapsed_time() >= audio_total_time() ) {
-            mp3dec_ex_seek(&g_audio.decoder, 0);
+    if ( g_audio.silent ) {
+        if ( g_audio.silent_stopped || g_audio.silent_position >= g_audio.total_time ) {
+            g_audio.silent_position = 0.0;
         }
-        g_audio.paused = false;
-        alSourcePlay(g_audio.source);
+        g_audio.silent_stopped = g_audio.paused = false;
+        return;
     }
+    if ( g_audio.mp3_data == NULL ) {
+        return;
+    }
+
+    // Played to the end, so start over
+    if ( has_ended() || audio_elapsed_time() >= audio_total_time() ) {
+        request_seek(0);
+    }
+    g_audio.paused = false;
+    atomic_store_explicit(&g_audio.play, true, memory_order_release);
+    wake_streamer();
 }
 
 void audio_pause(void) {
@@ -157,48 +630,27 @@ void audio_pause(void) {
     }
 
     g_audio.paused = true;
-    alSourcePause(g_audio.source);
-}
-
-void audio_seek(double time) {
-    if ( g_audio.stopped ) {
-        reset();
-    }
-    time = MAX(0.0, time);
-
-    uint64_t sample_pos = (uint64_t)(time * (double)g_audio.sample_rate * (double)g_audio.channels);
-
-    if ( sample_pos >= g_audio.total_samples ) {
-        sample_pos = g_audio.total_samples;
+    if ( !g_audio.silent ) {
+        atomic_store_explicit(&g_audio.play, false, memory_order_release);
+        wake_streamer();
     }
+}
 
-    mp3dec_ex_seek(&g_audio.decoder, sample_pos);
-
-    // Clear buffers and refill
-    alSourceStop(g_audio.source);
-    ALint queued;
-    alGetSourcei(g_audio.source, AL_BUFFERS_QUEUED, &queued);
-    while ( queued > 0 ) {
-        ALuint buffer;
-        alSourceUnqueueBuffers(g_audio.source, 1, &buffer);
-        queued--;
+void audio_seek(const double time) {
+    if ( g_audio.mp3_data == NULL ) {
+        return;
     }
-
-    for ( int i = 0; i < NUM_BUFFERS; i++ ) {
-        const size_t read = mp3dec_ex_read(&g_audio.decoder, g_audio.pcm_buffer, BUFFER_SIZE / sizeof(int16_t));
-        if ( i == 0 ) {
-            g_audio.last_first_decoded_sample = g_audio.decoder.cur_sample;
-        }
-        if ( read > 0 ) {
-            const int format = g_audio.channels == 2 ? AL_FORMAT_STEREO16 : AL_FORMAT_MONO16;
-            alBufferData(g_audio.buffers[i], format, g_audio.pcm_buffer, (ALsizei)(read * sizeof(int16_t)), g_audio.sample_rate);
-            alSourceQueueBuffers(g_audio.source, 1, &g_audio.buffers[i]);
-        }
+    if ( audio_is_paused() ) {
+        // Seeking after it stopped at the end leaves it paused
+        audio_pause();
     }
 
-    if ( !g_audio.paused ) {
-        alSourcePlay(g_audio.source);
+    if ( g_audio.silent ) {
+        g_audio.silent_stopped = false;
+        g_audio.silent_position = MIN(MAX(0.0, time), g_audio.total_time);
+        return;
     }
+    request_seek(time_to_sample(time));
 }
 
 void audio_seek_relative(const double diff) {
@@ -210,51 +662,81 @@ double audio_elapsed_time(void) {
     if ( g_audio.mp3_data == NULL ) {
         return 0.0;
     }
+    if ( g_audio.silent ) {
+        return g_audio.silent_position;
+    }
 
-    return (double)g_audio.last_first_decoded_sample / (double)g_audio.sample_rate / (double)g_audio.channels;
+    uint32_t sequence;
+    uint64_t sample;
+    double measured_time;
+    bool playing;
+    uint32_t position_generation;
+    do {
+        sequence = atomic_load_explicit(&g_audio.position_sequence, memory_order_acquire);
+        sample = atomic_load_explicit(&g_audio.position_sample, memory_order_relaxed);
+        measured_time = atomic_load_explicit(&g_audio.position_measured_time, memory_order_relaxed);
+        playing = atomic_load_explicit(&g_audio.position_playing, memory_order_relaxed);
+        position_generation = atomic_load_explicit(&g_audio.position_generation, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+    } while ( (sequence & 1) != 0 || sequence != atomic_load_explicit(&g_audio.position_sequence, memory_order_relaxed) );
+
+    // Until the streamer catches up with a seek, the song is where it was asked to be
+    const uint32_t generation = atomic_load_explicit(&g_audio.generation, memory_order_acquire);
+    if ( position_generation != generation ) {
+        g_audio.smooth_valid = false;
+        return sample_to_time(atomic_load_explicit(&g_audio.seek_sample, memory_order_relaxed));
+    }
+
+    // The measurement was taken a few milliseconds away from the start of the frame, and the source can only tell where it
+    // is every so often, so carry it over to the frame and ease into it instead of following every jump
+    const double now = clock_frame_time();
+    double measured = sample_to_time(sample);
+    if ( playing ) {
+        measured = MIN(MAX(0.0, measured + now - measured_time), g_audio.total_time);
+    }
+
+    if ( !g_audio.smooth_valid || !playing || g_audio.smooth_generation != generation ) {
+        g_audio.smooth_position = measured;
+    } else {
+        const double elapsed = MAX(0.0, now - g_audio.smooth_time);
+        const double predicted = g_audio.smooth_position + elapsed;
+        if ( fabs(measured - predicted) > POSITION_SNAP_SECONDS ) {
+            g_audio.smooth_position = measured;
+        } else {
+            const double correction = (measured - predicted) * (1.0 - exp(-elapsed / POSITION_SMOOTHING_SECONDS));
+            // Never back, so the lyrics never fill in reverse
+            g_audio.smooth_position = MAX(g_audio.smooth_position, predicted + correction);
+        }
+    }
+    g_audio.smooth_time = now;
+    g_audio.smooth_generation = generation;
+    g_audio.smooth_valid = true;
+    return g_audio.smooth_position;
 }
 
 double audio_total_time(void) { return g_audio.total_time; }
 
-bool audio_is_paused(void) { return g_audio.paused || g_audio.stopped; }
+bool audio_is_paused(void) { return g_audio.paused || has_ended(); }
 
 void audio_loop(void) {
-    if ( g_audio.mp3_data == NULL || g_audio.paused || g_audio.stopped ) {
+    if ( g_audio.mp3_data == NULL ) {
         return;
     }
-
-    ALint processed = 0;
-    alGetSourcei(g_audio.source, AL_BUFFERS_PROCESSED, &processed);
-    bool first = true;
-
-    while ( processed > 0 ) {
-        ALuint buffer;
-        alSourceUnqueueBuffers(g_audio.source, 1, &buffer);
-        check_al_error("alSourceUnqueueBuffers");
-        if ( first ) {
-            g_audio.last_first_decoded_sample = g_audio.decoder.cur_sample;
-            first = false;
+    if ( g_audio.silent ) {
+        if ( g_audio.paused || g_audio.silent_stopped ) {
+            return;
         }
-        const size_t read = mp3dec_ex_read(&g_audio.decoder, g_audio.pcm_buffer, BUFFER_SIZE / sizeof(int16_t));
-
-        if ( read > 0 ) {
-            const int format = g_audio.channels == 2 ? AL_FORMAT_STEREO16 : AL_FORMAT_MONO16;
-            alBufferData(buffer, format, g_audio.pcm_buffer, (ALsizei)(read * sizeof(int16_t)), g_audio.sample_rate);
-            check_al_error("alBufferData");
-            alSourceQueueBuffers(g_audio.source, 1, &buffer);
-            check_al_error("alSourceQueueBuffers");
-        } else {
-            // End of stream
-            g_audio.stopped = true;
+        g_audio.silent_position += clock_delta_time();
+        if ( g_audio.silent_position >= g_audio.total_time ) {
+            g_audio.silent_position = g_audio.total_time;
+            g_audio.silent_stopped = true;
         }
-
-        processed--;
+        return;
     }
 
-    ALint state;
-    alGetSourcei(g_audio.source, AL_SOURCE_STATE, &state);
-    if ( state != AL_PLAYING && !g_audio.paused && !g_audio.stopped ) {
-        alSourcePlay(g_audio.source);
-        check_al_error("alSourcePlay restart");
-    }
+#ifdef __EMSCRIPTEN__
+    // Without threads it's streamed a frame at a time instead, decoding just enough to refill every buffer
+    decode_step(NUM_BUFFERS);
+    stream_step();
+#endif
 }
@@ -7,8 +7,17 @@
 
 #include <stdbool.h>
 
-void audio_init(void);
+/**
+ * Opens the audio device, unless silent, in which case nothing is ever played and the song simply advances by the time
+ * of every frame (see clock_delta_time) while playing, for when the clock is deterministic and can't follow a device.
+ * Songs are decoded and streamed to the device on threads of their own, so the functions below only pass on commands and
+ * read the position they publish, and frames taking long never starve the device
+ */
+void audio_init(bool silent);
 void audio_finish(void);
+/**
+ * Advances a silent song, and streams the song where there are no threads to do it on (the web build)
+ */
 void audio_loop(void);
 void audio_load(const unsigned char *data, int data_size);
 void audio_resume(void);
@@ -16,6 +25,10 @@ void audio_pause(void);
 void audio_seek(double time);
 void audio_seek_relative(double diff);
 
+/**
+ * Where the song is at the time the current frame started (see clock_frame_time), easing into where the device says it
+ * is rather than jumping around. Everything drawn should use clock_song_time instead, which reads it once per frame
+ */
 double audio_elapsed_time(void);
 double audio_total_time(void);
 bool audio_is_paused(void);
@@ -0,0 +1,146 @@
+#include "bench.h"
+
+#include "audio.h"
+#include "clock.h"
+#include "constants.h"
+#include "error.h"
+#include "trace.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Distinct zones tracked, past which the rest are left out of the report
+#define BENCH_MAX_ZONES (32)
+// The zone that spans a whole frame
+#define BENCH_FRAME_ZONE "karaoke_loop"
+
+/**
+ * Time taken by a single zone on every frame it was seen in, in seconds
+ */
+typedef struct BenchZone_t {
+    WEAK const char *name;
+    OWNING double *samples;
+    size_t num_samples, capacity;
+    // Summed up over the frame being run, since a zone may be entered more than once per frame
+    double frame_time;
+    bool seen_this_frame;
+} BenchZone_t;
+
+typedef struct Bench_t {
+    BenchZone_t zones[BENCH_MAX_ZONES];
+    int32_t num_zones;
+} Bench_t;
+
+static void on_zone(void *user_data, const char *name, const double duration) {
+    Bench_t *bench = user_data;
+
+    BenchZone_t *zone = NULL;
+    for ( int32_t i = 0; i < bench->num_zones; i++ ) {
+        if ( strcmp(bench->zones[i].name, name) == 0 ) {
+            zone = &bench->zones[i];
+            break;
+        }
+    }
+    if ( zone == NULL ) {
+        if ( bench->num_zones == BENCH_MAX_ZONES ) {
+            return;
+        }
+        zone = &bench->zones[bench->num_zones++];
+        zone->name = name;
+    }
+
+    zone->frame_time += duration;
+    zone->seen_this_frame = true;
+}
+
+static void end_frame(Bench_t *bench) {
+    for ( int32_t i = 0; i < bench->num_zones; i++ ) {
+        BenchZone_t *zone = &bench->zones[i];
+        if ( !zone->seen_this_frame ) {
+            continue;
+        }
+
+        if ( zone->num_samples == zone->capacity ) {
+            zone->capacity = zone->capacity == 0 ? 1024 : zone->capacity * 2;
+            zone->samples = realloc(zone->samples, zone->capacity * sizeof(*zone->samples));
+            if ( zone->samples == NULL ) {
+                error_abort("Failed to allocate benchmark samples");
+            }
+        }
+        zone->samples[zone->num_samples++] = zone->frame_time;
+        zone->frame_time = 0.0;
+        zone->seen_this_frame = false;
+    }
+}
+
+static int compare_samples(const void *a, const void *b) {
+    const double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Nearest rank percentile of sorted samples, in milliseconds
+ */
+static double percentile_ms(const double *sorted, const size_t count, const double percent) {
+    const size_t rank = (size_t)ceil(percent / 100.0 * (double)count);
+    return sorted[MAX(rank, 1) - 1] * 1000.0;
+}
+
+static void print_report(Bench_t *bench, const int32_t num_frames, const double song_time) {
+    double total_time = 0.0;
+    for ( int32_t i = 0; i < bench->num_zones; i++ ) {
+        BenchZone_t *zone = &bench->zones[i];
+        qsort(zone->samples, zone->num_samples, sizeof(*zone->samples), compare_samples);
+        if ( strcmp(zone->name, BENCH_FRAME_ZONE) == 0 ) {
+            for ( size_t s = 0; s < zone->num_samples; s++ ) {
+                total_time += zone->samples[s];
+            }
+        }
+    }
+
+    printf("Benchmark: %d frames covering %.1f seconds of the song in %.2f seconds (%.1f frames per second)\n", num_frames,
+           song_time, total_time, total_time > 0.0 ? num_frames / total_time : 0.0);
+    printf("  %-40s %8s %8s %8s %8s %8s\n", "zone (ms)", "frames", "p50", "p90", "p99", "max");
+    for ( int32_t i = 0; i < bench->num_zones; i++ ) {
+        const BenchZone_t *zone = &bench->zones[i];
+        const double *sorted = zone->samples;
+        const size_t count = zone->num_samples;
+        printf("  %-40s %8zu %8.3f %8.3f %8.3f %8.3f\n", zone->name, count, percentile_ms(sorted, count, 50),
+               percentile_ms(sorted, count, 90), percentile_ms(sorted, count, 99), sorted[count - 1] * 1000.0);
+    }
+}
+
+void bench_run(const Karaoke_t *karaoke) {
+    Bench_t bench = {0};
+
+    // Whatever was traced while loading isn't part of any frame
+    uint64_t num_collected = trace_collect_zones(0, NULL, NULL);
+
+    clock_restart();
+    audio_seek(0.0);
+    audio_resume();
+
+    int32_t num_frames = 0;
+    // The audio stops by itself once the end of the song is reached
+    while ( !audio_is_paused() ) {
+        if ( karaoke_loop(karaoke) != 0 ) {
+            break;
+        }
+        num_collected = trace_collect_zones(num_collected, on_zone, &bench);
+        end_frame(&bench);
+        num_frames++;
+    }
+
+    if ( num_frames > 0 ) {
+        // The clock only reads where the song is when a frame starts, and the last one already ended
+        print_report(&bench, num_frames, audio_elapsed_time());
+    } else {
+        printf("Benchmark: no frames were run\n");
+    }
+
+    for ( int32_t i = 0; i < bench.num_zones; i++ ) {
+        free(bench.zones[i].samples);
+    }
+}
@@ -0,0 +1,20 @@
+/**
+ * bench.h - Plays a whole song offscreen on a deterministic clock, as fast as frames can be drawn, and reports how long they took
+ */
+
+#ifndef ETSUKO_BENCH_H
+#define ETSUKO_BENCH_H
+
+#include "karaoke.h"
+
+// How long every frame of the benchmark lasts in the song, unless the clock was given other frame times
+#define BENCH_TIMESTEP (1.0 / 60.0)
+
+/**
+ * Plays the loaded song from the start to the end, advancing every frame by the time the clock says no matter how long it took,
+ * then prints percentiles of the time taken by whole frames and by every zone traced in them (see trace.h).
+ * Expects the karaoke to be set up, the renderer to be headless and the clock to be deterministic, which --bench takes care of
+ */
+void bench_run(const Karaoke_t *karaoke);
+
+#endif // ETSUKO_BENCH_H
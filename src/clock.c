@@ -0,0 +1,103 @@
+#include "clock.h"
+
+#include "audio.h"
+#include "constants.h"
+#include "error.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+typedef struct Clock_t {
+    ClockSource_t source;
+    double fixed_step;
+    OWNING double *script;
+    int32_t script_length, script_next;
+    double frame_time;
+    double delta_time;
+    // Where the song was at the start of the frame
+    double song_time;
+    // System time the previous frame started at, while following the system clock
+    double prev_ticks;
+} Clock_t;
+
+static Clock_t g_clock = {0};
+
+static void set_source(const ClockSource_t source) {
+    free(g_clock.script);
+    g_clock.script = NULL;
+    g_clock.script_length = g_clock.script_next = 0;
+    g_clock.prev_ticks = 0;
+    g_clock.source = source;
+}
+
+void clock_use_real(void) { set_source(CLOCK_SOURCE_REAL); }
+
+void clock_use_fixed_step(const double step) {
+    if ( step <= 0 ) {
+        error_abort("Invalid clock step: %f", step);
+    }
+    set_source(CLOCK_SOURCE_FIXED_STEP);
+    g_clock.fixed_step = step;
+}
+
+void clock_use_script(const double *frame_durations, const int32_t count) {
+    if ( count <= 0 ) {
+        error_abort("The clock script has no frames");
+    }
+    set_source(CLOCK_SOURCE_SCRIPTED);
+
+    g_clock.script = malloc(sizeof(*g_clock.script) * count);
+    if ( g_clock.script == NULL ) {
+        error_abort("Failed to allocate the clock script");
+    }
+    memcpy(g_clock.script, frame_durations, sizeof(*g_clock.script) * count);
+    g_clock.script_length = count;
+}
+
+ClockSource_t clock_get_source(void) { return g_clock.source; }
+
+bool clock_is_deterministic(void) { return g_clock.source != CLOCK_SOURCE_REAL; }
+
+void clock_restart(void) {
+    g_clock.frame_time = g_clock.delta_time = g_clock.song_time = 0;
+    g_clock.script_next = 0;
+    g_clock.prev_ticks = 0;
+}
+
+void clock_begin_frame(void) {
+    switch ( g_clock.source ) {
+    case CLOCK_SOURCE_REAL: {
+        const double ticks = glfwGetTime();
+        if ( g_clock.prev_ticks != 0 ) {
+            g_clock.delta_time = ticks - g_clock.prev_ticks;
+        }
+        g_clock.prev_ticks = ticks;
+        g_clock.frame_time = ticks;
+        break;
+    }
+    case CLOCK_SOURCE_FIXED_STEP:
+        g_clock.delta_time = g_clock.fixed_step;
+        g_clock.frame_time += g_clock.delta_time;
+        break;
+    case CLOCK_SOURCE_SCRIPTED:
+        g_clock.delta_time = g_clock.script[MIN(g_clock.script_next, g_clock.script_length - 1)];
+        g_clock.script_next = MIN(g_clock.script_next + 1, g_clock.script_length);
+        g_clock.frame_time += g_clock.delta_time;
+        break;
+    }
+    // Read once so that everything in the frame agrees on where the song is
+    g_clock.song_time = audio_elapsed_time();
+}
+
+double clock_frame_time(void) { return g_clock.frame_time; }
+
+double clock_delta_time(void) { return g_clock.delta_time; }
+
+double clock_song_time(void) { return g_clock.song_time; }
+
+double clock_system_time(void) { return glfwGetTime(); }
+
+double clock_budget_time(void) { return clock_is_deterministic() ? g_clock.frame_time : clock_system_time(); }
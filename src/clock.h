@@ -0,0 +1,74 @@
+/**
+ * clock.h - The one place time is read from: when the current frame happens, how long the previous one lasted and where the
+ * song is. Where that comes from depends on the source of the clock, so that a song can be replayed frame by frame exactly
+ * the same way every time, e.g. to benchmark it
+ */
+
+#ifndef ETSUKO_CLOCK_H
+#define ETSUKO_CLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum ClockSource_t {
+    // Frames follow the system clock and the song follows the audio device
+    CLOCK_SOURCE_REAL = 0,
+    // Every frame lasts exactly the same time
+    CLOCK_SOURCE_FIXED_STEP,
+    // Every frame lasts as long as the next duration of a script, and the last one for as long as frames keep coming
+    CLOCK_SOURCE_SCRIPTED,
+} ClockSource_t;
+
+/**
+ * Follows the system clock from the next frame on. This is the default
+ */
+void clock_use_real(void);
+/**
+ * Makes every frame from the next one on last exactly step seconds, no matter how long it actually took
+ */
+void clock_use_fixed_step(double step);
+/**
+ * Makes the next frames last as long as the given durations (in seconds), which are copied
+ */
+void clock_use_script(const double *frame_durations, int32_t count);
+ClockSource_t clock_get_source(void);
+/**
+ * Whether time only moves with frames, in which case the song can't follow the audio device and plays silently instead
+ * (see audio_init)
+ */
+bool clock_is_deterministic(void);
+
+/**
+ * Starts the clock over from time 0 and the first frame of the script, so that whatever happened before (like however long
+ * loading took) doesn't change what comes after
+ */
+void clock_restart(void);
+/**
+ * Moves the clock to the next frame. Called once at the start of every frame by events_loop
+ */
+void clock_begin_frame(void);
+/**
+ * Time at the start of the current frame in seconds, which stays the same throughout it. Drives the animated backgrounds
+ */
+double clock_frame_time(void);
+/**
+ * How long the previous frame lasted in seconds. Drives the animations
+ */
+double clock_delta_time(void);
+/**
+ * Where the song playing was at the start of the current frame in seconds, which stays the same throughout it even if the
+ * song is seeked. Drives the lyrics
+ */
+double clock_song_time(void);
+/**
+ * Time to check budgets of work done within a frame against. That's the system clock, unless the clock is deterministic,
+ * in which case it stands still so that the same work is done every run
+ */
+double clock_budget_time(void);
+/**
+ * The system clock in seconds, whatever the source of the clock is, on the same timeline clock_frame_time follows when it's
+ * real. Unlike everything else here it can be called from any thread, e.g. to tell when the audio device was at some point
+ */
+double clock_system_time(void);
+
+#endif // ETSUKO_CLOCK_H
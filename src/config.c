@@ -52,6 +52,19 @@ static Config_t *get_default_config(void) {
     config->enable_dynamic_fill = true;
     config->enable_reading_hints = true;
     config->enable_pulse_effect = true;
+    config->enable_sdf_lyrics = true;
+    config->enable_glyph_quad_lyrics = true;
+    config->enable_partial_redraw = true;
+    config->bg_resolution_divisor = 4;
+    config->bg_update_interval = 1;
+    config->enable_gpu_timing = false;
+    config->enable_tracing = false;
+    config->bench_mode = false;
+    config->export_file = NULL;
+    config->export_format = EXPORT_FORMAT_Y4M;
+    config->export_width = 1920;
+    config->export_height = 1080;
+    config->export_fps = 60;
 
 #ifdef __EMSCRIPTEN__
     try_load_config_web(config);
@@ -6,6 +6,7 @@
 #define ETSUKO_CONFIG_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "constants.h"
 
@@ -13,6 +14,13 @@ typedef enum Config_OpMode_t {
     APP_MODE_KARAOKE = 0,
 } Config_OpMode_t;
 
+typedef enum Config_ExportFormat_t {
+    // Raw RGBA pixels, one frame after the other
+    EXPORT_FORMAT_RGBA = 0,
+    // YUV4MPEG2 stream in 4:2:0, which carries its own size and frame rate
+    EXPORT_FORMAT_Y4M,
+} Config_ExportFormat_t;
+
 typedef struct {
     OWNING char *ui_font, *lyrics_font;
     OWNING char *song_file;
@@ -25,6 +33,25 @@ typedef struct {
     bool enable_dynamic_fill;
     bool enable_reading_hints;
     bool enable_pulse_effect;
+    bool enable_sdf_lyrics;
+    bool enable_glyph_quad_lyrics;
+    bool enable_partial_redraw;
+    // The animated backgrounds are drawn at the window size divided by this and then scaled up to fill it
+    int32_t bg_resolution_divisor;
+    // How many frames an animated background is kept for before drawing it again, blending into the new one in between
+    int32_t bg_update_interval;
+    // Measure how long the GPU spends on every pass of a frame, printed with the G key
+    bool enable_gpu_timing;
+    // Record the CPU time of the main phases of every frame, exported as a Chrome trace with the T key and at exit
+    bool enable_tracing;
+    // Set by --bench: play the whole song offscreen as fast as possible and report how long frames took
+    bool bench_mode;
+    // Set by --export: where to write the frames of the whole song rendered offscreen, "-" being stdout
+    OWNING MAYBE_NULL char *export_file;
+    Config_ExportFormat_t export_format;
+    // Size in pixels and frame rate of the frames exported
+    int32_t export_width, export_height;
+    int32_t export_fps;
 } Config_t;
 
 Config_t *config_get(void);
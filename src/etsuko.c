@@ -5,26 +5,38 @@
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
 
+#include "config.h"
 #include "error.h"
+#include "jobs.h"
 #include "renderer.h"
+#include "trace.h"
 
 static void error_callback(const int error, const char *description) {
     fprintf(stderr, "GLFW Error %d: %s\n", error, description);
 }
 
 int global_init(void) {
+    const Config_t *config = config_get();
+    const bool headless = config->bench_mode || config->export_file != NULL;
+    // Benchmarks take their frame times from the zones
+    trace_init(config->enable_tracing || config->bench_mode);
     glfwSetErrorCallback(error_callback);
-
     if ( !glfwInit() ) {
         error_abort("glfwInit failed");
     }
 
-    render_init();
+    render_init(headless);
+    jobs_init();
 
     return 0;
 }
 
 void global_finish(void) {
+    jobs_finish();
     render_finish();
+    if ( config_get()->enable_tracing ) {
+        trace_export(TRACE_DEFAULT_FILE);
+    }
+    trace_finish();
     glfwTerminate();
 }
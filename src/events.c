@@ -1,5 +1,7 @@
 #include "events.h"
 
+#include "clock.h"
+
 #include <stdio.h>
 #include <string.h>
 
@@ -10,8 +12,6 @@ static int32_t g_mouse_x, g_mouse_y;
 static bool g_mouse_clicked = false;
 static bool g_key_presses[KEY_INVALID] = {0};
 static double g_window_pixel_scale = 1.0;
-static double g_prev_ticks = 0;
-static double g_delta_time = 0;
 
 static void clear_key_presses(void) { memset(g_key_presses, 0, sizeof(g_key_presses)); }
 
@@ -37,6 +37,12 @@ static void key_callback(GLFWwindow *, const int key, int, const int action, int
         case GLFW_KEY_L:
             k = KEY_L;
             break;
+        case GLFW_KEY_G:
+            k = KEY_G;
+            break;
+        case GLFW_KEY_T:
+            k = KEY_T;
+            break;
         default:
             return;
         }
@@ -80,11 +86,7 @@ void events_init(void) {}
 void events_finish(void) {}
 
 void events_loop(void) {
-    const double ticks = glfwGetTime();
-    if ( g_prev_ticks != 0 ) {
-        g_delta_time = ticks - g_prev_ticks;
-    }
-    g_prev_ticks = ticks;
+    clock_begin_frame();
 
     glfwPollEvents();
 
@@ -102,9 +104,6 @@ void events_frame_end(void) {
     clear_key_presses();
 }
 
-double events_get_delta_time(void) { return g_delta_time; }
-double events_get_elapsed_time(void) { return glfwGetTime(); }
-
 void events_get_mouse_position(int32_t *x, int32_t *y) {
     if ( x != NULL )
         *x = g_mouse_x;
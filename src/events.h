@@ -8,7 +8,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 
-typedef enum Key_t { KEY_SPACE = 0, KEY_ARROW_LEFT, KEY_ARROW_RIGHT, KEY_R, KEY_L, KEY_INVALID } Key_t;
+typedef enum Key_t { KEY_SPACE = 0, KEY_ARROW_LEFT, KEY_ARROW_RIGHT, KEY_R, KEY_L, KEY_G, KEY_T, KEY_INVALID } Key_t;
 
 // Init, finish and loop
 void events_init(void);
@@ -23,8 +23,6 @@ void events_setup_callbacks(void *window);
 bool events_has_quit(void);
 bool events_window_changed(void);
 // Queries for state
-double events_get_delta_time(void);
-double events_get_elapsed_time(void);
 void events_get_mouse_position(int32_t *x, int32_t *y);
 bool events_get_mouse_click(int32_t *x, int32_t *y);
 double events_get_mouse_scrolled(void);
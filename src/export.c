@@ -0,0 +1,194 @@
+#include "export.h"
+
+#include "audio.h"
+#include "clock.h"
+#include "error.h"
+#include "renderer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct Export_t {
+    OWNING MAYBE_NULL FILE *file;
+    Config_ExportFormat_t format;
+    int32_t width, height, fps;
+    // A single row of RGBA pixels, or the three planes of a whole Y4M frame
+    OWNING uint8_t *buffer;
+    size_t buffer_size;
+    // Frames captured while the song loads aren't part of the video
+    bool recording;
+    bool failed;
+    int64_t frames_written;
+} Export_t;
+
+static Export_t g_export = {0};
+
+static uint8_t rgb_to_y(const int32_t r, const int32_t g, const int32_t b) {
+    return (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+// The offset keeps the sums positive before shifting, and includes the 128 the chroma is centered on
+static uint8_t rgb_to_u(const int32_t r, const int32_t g, const int32_t b) {
+    return (uint8_t)((-38 * r - 74 * g + 112 * b + 32896) >> 8);
+}
+
+static uint8_t rgb_to_v(const int32_t r, const int32_t g, const int32_t b) {
+    return (uint8_t)((112 * r - 94 * g - 18 * b + 32896) >> 8);
+}
+
+static bool write_rgba_frame(const uint8_t *pixels, const int32_t width, const int32_t height) {
+    const size_t stride = (size_t)width * 4;
+    for ( int32_t y = 0; y < height; y++ ) {
+        // Captured from the bottom up
+        memcpy(g_export.buffer, pixels + (size_t)(height - 1 - y) * stride, stride);
+        // Alpha is whatever blending left behind, which the window never shows
+        for ( size_t i = 3; i < stride; i += 4 ) {
+            g_export.buffer[i] = 255;
+        }
+        if ( fwrite(g_export.buffer, 1, stride, g_export.file) != stride ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Converts to BT.601 YUV in 4:2:0, averaging the color of every 2x2 block of pixels
+ */
+static bool write_y4m_frame(const uint8_t *pixels, const int32_t width, const int32_t height) {
+    const size_t stride = (size_t)width * 4;
+    uint8_t *y_plane = g_export.buffer;
+    uint8_t *u_plane = y_plane + (size_t)width * height;
+    uint8_t *v_plane = u_plane + (size_t)(width / 2) * (height / 2);
+
+    for ( int32_t y = 0; y < height; y += 2 ) {
+        const uint8_t *rows[2] = {pixels + (size_t)(height - 1 - y) * stride, pixels + (size_t)(height - 2 - y) * stride};
+        for ( int32_t x = 0; x < width; x += 2 ) {
+            int32_t r = 0, g = 0, b = 0;
+            for ( int32_t i = 0; i < 4; i++ ) {
+                const uint8_t *pixel = rows[i / 2] + (size_t)(x + i % 2) * 4;
+                y_plane[(size_t)(y + i / 2) * width + x + i % 2] = rgb_to_y(pixel[0], pixel[1], pixel[2]);
+                r += pixel[0];
+                g += pixel[1];
+                b += pixel[2];
+            }
+            const size_t chroma = (size_t)(y / 2) * (width / 2) + x / 2;
+            u_plane[chroma] = rgb_to_u((r + 2) / 4, (g + 2) / 4, (b + 2) / 4);
+            v_plane[chroma] = rgb_to_v((r + 2) / 4, (g + 2) / 4, (b + 2) / 4);
+        }
+    }
+
+    return fputs("FRAME\n", g_export.file) >= 0 &&
+           fwrite(g_export.buffer, 1, g_export.buffer_size, g_export.file) == g_export.buffer_size;
+}
+
+static void on_frame_captured(void *, const uint8_t *pixels, const int32_t width, const int32_t height) {
+    if ( !g_export.recording || g_export.failed ) {
+        return;
+    }
+
+    const bool written = g_export.format == EXPORT_FORMAT_Y4M ? write_y4m_frame(pixels, width, height)
+                                                               : write_rgba_frame(pixels, width, height);
+    if ( !written ) {
+        fprintf(stderr, "Failed to write frame %lld of the export\n", (long long)g_export.frames_written);
+        g_export.failed = true;
+        return;
+    }
+    g_export.frames_written++;
+}
+
+static FILE *open_output(const char *path) {
+    if ( strcmp(path, EXPORT_STDOUT) != 0 ) {
+        return fopen(path, "wb");
+    }
+
+    // Keep stdout to the frames by sending everything else printed there to stderr
+    fflush(stdout);
+    const int fd = dup(STDOUT_FILENO);
+    if ( fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0 ) {
+        return NULL;
+    }
+    return fdopen(fd, "wb");
+}
+
+bool export_init(const char *path, const Config_ExportFormat_t format, const int32_t width, const int32_t height,
+                 const int32_t fps) {
+    if ( width <= 0 || height <= 0 || fps <= 0 ) {
+        fprintf(stderr, "Invalid export size %dx%d at %d fps\n", width, height, fps);
+        return false;
+    }
+    if ( format == EXPORT_FORMAT_Y4M && (width % 2 != 0 || height % 2 != 0) ) {
+        fprintf(stderr, "Y4M exports need an even width and height, not %dx%d\n", width, height);
+        return false;
+    }
+
+    g_export = (Export_t){.format = format, .width = width, .height = height, .fps = fps};
+    g_export.file = open_output(path);
+    if ( g_export.file == NULL ) {
+        fprintf(stderr, "Failed to open %s to export to\n", path);
+        return false;
+    }
+
+    g_export.buffer_size = format == EXPORT_FORMAT_Y4M ? (size_t)width * height * 3 / 2 : (size_t)width * 4;
+    g_export.buffer = malloc(g_export.buffer_size);
+    if ( g_export.buffer == NULL ) {
+        error_abort("Failed to allocate the export buffer");
+    }
+
+    if ( format == EXPORT_FORMAT_Y4M ) {
+        fprintf(g_export.file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, fps);
+    }
+
+    if ( !render_begin_capture(width, height, on_frame_captured, NULL) ) {
+        fprintf(stderr, "Frames can't be captured here\n");
+        export_finish();
+        return false;
+    }
+    return true;
+}
+
+void export_finish(void) {
+    render_end_capture();
+    if ( g_export.file != NULL ) {
+        if ( fclose(g_export.file) != 0 ) {
+            fprintf(stderr, "Failed to finish writing the export\n");
+        }
+        g_export.file = NULL;
+    }
+    free(g_export.buffer);
+    g_export.buffer = NULL;
+}
+
+bool export_run(const Karaoke_t *karaoke) {
+    // Start over so that the last frame of the loading screen, still being read back, is dropped
+    render_end_capture();
+    if ( !render_begin_capture(g_export.width, g_export.height, on_frame_captured, NULL) ) {
+        return false;
+    }
+
+    clock_restart();
+    audio_seek(0.0);
+    audio_resume();
+    g_export.recording = true;
+
+    const double total_time = audio_total_time();
+    int32_t num_frames = 0;
+    // The audio stops by itself once the end of the song is reached
+    while ( !audio_is_paused() && !g_export.failed ) {
+        if ( karaoke_loop(karaoke) != 0 ) {
+            break;
+        }
+        if ( ++num_frames % g_export.fps == 0 ) {
+            fprintf(stderr, "\rExporting: %.0f of %.0f seconds", clock_song_time(), total_time);
+        }
+    }
+    // The last frame is still being read back
+    render_end_capture();
+    g_export.recording = false;
+
+    fprintf(stderr, "\rExported %lld frames at %dx%d, %d fps (%.1f seconds)\n", (long long)g_export.frames_written,
+            g_export.width, g_export.height, g_export.fps, (double)g_export.frames_written / g_export.fps);
+    return !g_export.failed;
+}
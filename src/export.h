@@ -0,0 +1,33 @@
+/**
+ * export.h - Renders a whole song offscreen at a fixed frame rate, as fast as frames can be drawn, writing every frame out as
+ * raw video for some other program to encode (and add the audio to)
+ */
+
+#ifndef ETSUKO_EXPORT_H
+#define ETSUKO_EXPORT_H
+
+#include "config.h"
+#include "karaoke.h"
+
+// Path that exports to stdout instead of a file
+#define EXPORT_STDOUT "-"
+
+/**
+ * Opens the file frames are written to and starts capturing them at the given size (see render_begin_capture), which is why
+ * it has to be called before the karaoke is created. When exporting to stdout, everything else printed there goes to stderr
+ * instead. Y4M needs an even width and height.
+ * Returns false if the export can't be done, having printed why
+ */
+bool export_init(const char *path, Config_ExportFormat_t format, int32_t width, int32_t height, int32_t fps);
+/**
+ * Flushes and closes the file frames were written to
+ */
+void export_finish(void);
+/**
+ * Plays the loaded song from the start to the end, one frame every 1/fps seconds of the song no matter how long it took,
+ * writing each one out. Expects the clock to step by 1/fps, which --export takes care of.
+ * Returns false if writing failed at some point
+ */
+bool export_run(const Karaoke_t *karaoke);
+
+#endif // ETSUKO_EXPORT_H
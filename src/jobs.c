@@ -0,0 +1,171 @@
+#include "jobs.h"
+
+#include "constants.h"
+#include "error.h"
+#include "trace.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#ifndef __EMSCRIPTEN__
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#endif
+
+#define JOBS_MAX_WORKERS (31)
+
+#ifndef __EMSCRIPTEN__
+
+typedef struct JobPool_t {
+    pthread_t workers[JOBS_MAX_WORKERS];
+    int32_t num_workers;
+    pthread_mutex_t mutex;
+    // Signals the workers that a new batch was submitted (or that they should stop), and the submitter that a batch is done
+    pthread_cond_t work_cond, done_cond;
+    uint64_t batch_id;
+    bool stopping;
+
+    // Current batch. Items are claimed by bumping next_index until it reaches count
+    JobFunc_t func;
+    void *user_data;
+    int32_t count;
+    atomic_int next_index;
+    // Workers that haven't finished their part of the current batch yet
+    int32_t busy_workers;
+} JobPool_t;
+
+static JobPool_t *g_jobs = NULL;
+
+static void run_batch_items(JobPool_t *pool) {
+    int32_t index;
+    while ( (index = atomic_fetch_add(&pool->next_index, 1)) < pool->count ) {
+        pool->func(pool->user_data, index);
+    }
+}
+
+static void *worker_main(void *arg) {
+    JobPool_t *pool = arg;
+    uint64_t last_batch = 0;
+    trace_set_thread_name("jobs worker");
+
+    pthread_mutex_lock(&pool->mutex);
+    while ( true ) {
+        while ( !pool->stopping && pool->batch_id == last_batch ) {
+            pthread_cond_wait(&pool->work_cond, &pool->mutex);
+        }
+        if ( pool->stopping )
+            break;
+
+        last_batch = pool->batch_id;
+        pthread_mutex_unlock(&pool->mutex);
+
+        run_batch_items(pool);
+
+        pthread_mutex_lock(&pool->mutex);
+        if ( --pool->busy_workers == 0 ) {
+            pthread_cond_signal(&pool->done_cond);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return NULL;
+}
+
+void jobs_init(void) {
+    if ( g_jobs != NULL ) {
+        return;
+    }
+
+    g_jobs = calloc(1, sizeof(*g_jobs));
+    if ( g_jobs == NULL ) {
+        error_abort("Failed to allocate the job pool");
+    }
+
+    pthread_mutex_init(&g_jobs->mutex, NULL);
+    pthread_cond_init(&g_jobs->work_cond, NULL);
+    pthread_cond_init(&g_jobs->done_cond, NULL);
+
+    const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    const int32_t wanted_workers = (int32_t)MIN(JOBS_MAX_WORKERS, MAX(0, cores - 1));
+
+    for ( int32_t i = 0; i < wanted_workers; i++ ) {
+        if ( pthread_create(&g_jobs->workers[g_jobs->num_workers], NULL, worker_main, g_jobs) != 0 ) {
+            // Not fatal, the work is simply split across fewer threads
+            break;
+        }
+        g_jobs->num_workers++;
+    }
+}
+
+void jobs_finish(void) {
+    if ( g_jobs == NULL ) {
+        return;
+    }
+
+    pthread_mutex_lock(&g_jobs->mutex);
+    g_jobs->stopping = true;
+    pthread_cond_broadcast(&g_jobs->work_cond);
+    pthread_mutex_unlock(&g_jobs->mutex);
+
+    for ( int32_t i = 0; i < g_jobs->num_workers; i++ ) {
+        pthread_join(g_jobs->workers[i], NULL);
+    }
+
+    pthread_cond_destroy(&g_jobs->done_cond);
+    pthread_cond_destroy(&g_jobs->work_cond);
+    pthread_mutex_destroy(&g_jobs->mutex);
+    free(g_jobs);
+    g_jobs = NULL;
+}
+
+void jobs_parallel_for(const int32_t count, const JobFunc_t func, void *user_data) {
+    if ( count <= 0 ) {
+        return;
+    }
+
+    if ( g_jobs == NULL || g_jobs->num_workers == 0 || count == 1 ) {
+        for ( int32_t i = 0; i < count; i++ ) {
+            func(user_data, i);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&g_jobs->mutex);
+    g_jobs->func = func;
+    g_jobs->user_data = user_data;
+    g_jobs->count = count;
+    atomic_store(&g_jobs->next_index, 0);
+    g_jobs->busy_workers = g_jobs->num_workers;
+    g_jobs->batch_id++;
+    pthread_cond_broadcast(&g_jobs->work_cond);
+    pthread_mutex_unlock(&g_jobs->mutex);
+
+    run_batch_items(g_jobs);
+
+    pthread_mutex_lock(&g_jobs->mutex);
+    while ( g_jobs->busy_workers > 0 ) {
+        pthread_cond_wait(&g_jobs->done_cond, &g_jobs->mutex);
+    }
+    pthread_mutex_unlock(&g_jobs->mutex);
+}
+
+int32_t jobs_thread_count(void) { return g_jobs != NULL ? g_jobs->num_workers + 1 : 1; }
+
+#else
+
+// The web build is not compiled with thread support, so everything simply runs on the calling thread
+
+void jobs_init(void) {}
+
+void jobs_finish(void) {}
+
+void jobs_parallel_for(const int32_t count, const JobFunc_t func, void *user_data) {
+    for ( int32_t i = 0; i < count; i++ ) {
+        func(user_data, i);
+    }
+}
+
+int32_t jobs_thread_count(void) { return 1; }
+
+#endif
@@ -0,0 +1,37 @@
+/**
+ * jobs.h - Small pool of worker threads used to split CPU heavy work (e.g. rasterizing glyphs) across every core.
+ * Nothing submitted to it may touch the GL context, which only exists on the main thread
+ */
+
+#ifndef ETSUKO_JOBS_H
+#define ETSUKO_JOBS_H
+
+#include <stdint.h>
+
+/**
+ * Function run for a single item of a parallel loop, receiving the user data given to jobs_parallel_for and the index
+ * of the item
+ */
+typedef void (*JobFunc_t)(void *user_data, int32_t index);
+
+/**
+ * Starts the worker threads, one less than the number of available cores since the calling thread also takes part in the work.
+ * On platforms without threads (e.g. the web build) no workers are started and all the work runs on the calling thread
+ */
+void jobs_init(void);
+/**
+ * Stops and joins all the worker threads
+ */
+void jobs_finish(void);
+/**
+ * Calls func once for every index from 0 up to count (exclusive), spread across the workers and the calling thread,
+ * and only returns once all of them are done. Items may run in any order and at the same time, so func must not touch
+ * anything shared without synchronizing it first. Must only be called from the main thread
+ */
+void jobs_parallel_for(int32_t count, JobFunc_t func, void *user_data);
+/**
+ * Returns how many threads take part in a parallel loop, counting the calling thread
+ */
+int32_t jobs_thread_count(void);
+
+#endif // ETSUKO_JOBS_H
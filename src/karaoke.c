@@ -1,10 +1,12 @@
 #include "karaoke.h"
 #include "audio.h"
+#include "clock.h"
 #include "config.h"
 #include "error.h"
 #include "events.h"
 #include "repository.h"
 #include "song.h"
+#include "trace.h"
 #include "ui.h"
 #include "ui_ex.h"
 
@@ -55,7 +57,7 @@ Karaoke_t *karaoke_init(void) {
 
     karaoke->ui = ui_init();
     events_init();
-    audio_init();
+    audio_init(clock_is_deterministic());
 
     return karaoke;
 }
@@ -504,7 +506,7 @@ void karaoke_setup(Karaoke_t *state) {
 }
 
 static void update_elapsed_text(const Karaoke_t *state) {
-    const double elapsed = audio_elapsed_time();
+    const double elapsed = clock_song_time();
     const int32_t minutes = (int32_t)(elapsed / 60);
     const int32_t seconds = (int32_t)elapsed % 60;
 
@@ -522,7 +524,7 @@ static void update_elapsed_text(const Karaoke_t *state) {
 }
 
 static void update_remaining_text(const Karaoke_t *state) {
-    const double remaining = audio_total_time() - audio_elapsed_time();
+    const double remaining = audio_total_time() - clock_song_time();
     const int32_t minutes = (int32_t)(remaining / 60);
     const int32_t seconds = (int32_t)remaining % 60;
     char *time_str;
@@ -540,7 +542,7 @@ static void update_remaining_text(const Karaoke_t *state) {
 
 static void update_song_progressbar(const Karaoke_t *state) {
     if ( state->song_progressbar != NULL ) {
-        const double progress = audio_elapsed_time() / audio_total_time();
+        const double progress = clock_song_time() / audio_total_time();
         ((Drawable_ProgressBarData_t *)state->song_progressbar->custom_data)->progress = (float)progress;
     }
 }
@@ -587,6 +589,12 @@ static void check_user_input(const Karaoke_t *state) {
     } else if ( events_key_was_pressed(KEY_L) ) {
         toggle_show_lyrics(state);
     }
+    if ( config_get()->enable_gpu_timing && events_key_was_pressed(KEY_G) ) {
+        render_print_gpu_timings();
+    }
+    if ( config_get()->enable_tracing && events_key_was_pressed(KEY_T) ) {
+        trace_export(TRACE_DEFAULT_FILE);
+    }
 
     int32_t mouse_x;
     // Check if the user clicked the progress bar
@@ -608,7 +616,7 @@ static void check_user_input(const Karaoke_t *state) {
         state->song_name_text->enabled = state->song_artist_album_text->enabled = false;
         state->song_controls_container->enabled = true;
     } else {
-        const bool is_not_played = audio_elapsed_time() < 0.1 && audio_is_paused();
+        const bool is_not_played = clock_song_time() < 0.1 && audio_is_paused();
         state->song_name_text->enabled = state->song_artist_album_text->enabled = !is_not_played;
         state->song_controls_container->enabled = is_not_played;
     }
@@ -619,20 +627,29 @@ static void check_user_input(const Karaoke_t *state) {
 }
 
 int karaoke_loop(const Karaoke_t *state) {
+    TRACE_BEGIN("karaoke_loop");
+    TRACE_BEGIN("events");
     events_loop();
-    if ( events_has_quit() )
+    TRACE_END();
+    if ( events_has_quit() ) {
+        TRACE_END();
         return -1;
+    }
     audio_loop();
 
     // Check for user inputs
+    TRACE_BEGIN("input");
     check_user_input(state);
+    TRACE_END();
 
     ui_begin_loop(state->ui);
     // Recalculate dynamic elements
+    TRACE_BEGIN("update_texts");
     update_elapsed_text(state);
     update_remaining_text(state);
     update_song_progressbar(state);
     update_play_pause_state(state);
+    TRACE_END();
     // Update the lyrics view
     if ( events_window_changed() )
         ui_ex_lyrics_view_on_screen_change(state->ui, state->lyrics_view);
@@ -643,8 +660,11 @@ int karaoke_loop(const Karaoke_t *state) {
     events_frame_end();
 
     ui_draw(state->ui);
+    TRACE_BEGIN("present");
     ui_end_loop();
+    TRACE_END();
 
+    TRACE_END();
     return 0;
 }
 
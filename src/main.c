@@ -1,12 +1,16 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "bench.h"
+#include "clock.h"
+#include "config.h"
+#include "error.h"
 #include "etsuko.h"
+#include "export.h"
 #include "karaoke.h"
 
 #ifdef __EMSCRIPTEN__
-#include "error.h"
-
 #include <emscripten.h>
 
 typedef struct {
@@ -35,8 +39,105 @@ static void web_entrypoint(void *em_arg) {
 }
 #endif
 
-int main(void) {
+#ifndef __EMSCRIPTEN__
+/**
+ * Makes the clock replay the frame durations in a file, in seconds separated by whitespace
+ */
+static bool load_frame_times(const char *path) {
+    FILE *file = fopen(path, "r");
+    if ( file == NULL ) {
+        fprintf(stderr, "Failed to open frame times %s\n", path);
+        return false;
+    }
+
+    double *durations = NULL;
+    int32_t count = 0, capacity = 0;
+    double duration;
+    while ( fscanf(file, "%lf", &duration) == 1 ) {
+        if ( count == capacity ) {
+            capacity = capacity == 0 ? 1024 : capacity * 2;
+            durations = realloc(durations, sizeof(*durations) * capacity);
+            if ( durations == NULL ) {
+                error_abort("Failed to allocate frame times");
+            }
+        }
+        durations[count++] = duration;
+    }
+    const bool read_all = feof(file);
+    fclose(file);
+
+    if ( !read_all || count == 0 ) {
+        fprintf(stderr, "Frame times %s should be a list of durations in seconds\n", path);
+        free(durations);
+        return false;
+    }
+    clock_use_script(durations, count);
+    free(durations);
+    return true;
+}
+
+/**
+ * Applies the command line to the config and clock: --bench to benchmark instead of opening a window, --frame-times to
+ * replay the frame durations in a file, --export to write the frames of the song to a file instead (with --size, --fps and
+ * --format) and the song file to play instead of the default one.
+ * Returns false if there's anything it doesn't understand
+ */
+static bool parse_args(const int argc, char **argv) {
+    Config_t *config = config_get();
+    for ( int i = 1; i < argc; i++ ) {
+        const bool has_value = i + 1 < argc;
+        if ( strcmp(argv[i], "--bench") == 0 ) {
+            config->bench_mode = true;
+        } else if ( strcmp(argv[i], "--frame-times") == 0 && has_value ) {
+            if ( !load_frame_times(argv[++i]) ) {
+                return false;
+            }
+        } else if ( strcmp(argv[i], "--export") == 0 && has_value ) {
+            free(config->export_file);
+            config->export_file = strdup(argv[++i]);
+        } else if ( strcmp(argv[i], "--size") == 0 && has_value ) {
+            if ( sscanf(argv[++i], "%dx%d", &config->export_width, &config->export_height) != 2 ) {
+                return false;
+            }
+        } else if ( strcmp(argv[i], "--fps") == 0 && has_value ) {
+            config->export_fps = (int32_t)strtol(argv[++i], NULL, 10);
+        } else if ( strcmp(argv[i], "--format") == 0 && has_value ) {
+            i++;
+            if ( strcmp(argv[i], "rgba") == 0 ) {
+                config->export_format = EXPORT_FORMAT_RGBA;
+            } else if ( strcmp(argv[i], "y4m") == 0 ) {
+                config->export_format = EXPORT_FORMAT_Y4M;
+            } else {
+                return false;
+            }
+        } else if ( strncmp(argv[i], "--", 2) != 0 ) {
+            free(config->song_file);
+            config->song_file = strdup(argv[i]);
+        } else {
+            return false;
+        }
+    }
+
+    if ( config->export_file != NULL ) {
+        if ( config->bench_mode || config->export_fps <= 0 ) {
+            return false;
+        }
+        // Every frame of the video lasts the same
+        clock_use_fixed_step(1.0 / config->export_fps);
+    }
+    // Benchmarks have to replay the same frames every time
+    if ( config->bench_mode && !clock_is_deterministic() ) {
+        clock_use_fixed_step(BENCH_TIMESTEP);
+    }
+    return true;
+}
+#endif
+
+int main(int argc, char **argv) {
+    bool succeeded = true;
 #ifdef __EMSCRIPTEN__
+    (void)argc;
+    (void)argv;
     EntryPointArgs_t *args = calloc(1, sizeof(*args));
     if ( args == NULL ) {
         error_abort("Failed to allocate args for emscripten");
@@ -50,21 +151,42 @@ int main(void) {
     }
     free(args);
 #else
+    if ( !parse_args(argc, argv) ) {
+        printf("Usage: %s [--bench] [--frame-times file] [--export file|- [--size WxH] [--fps N] [--format y4m|rgba]] "
+               "[song file]\n",
+               argv[0]);
+        return EXIT_FAILURE;
+    }
     if ( global_init() != 0 ) {
         printf("Failed to initialize global");
         return EXIT_FAILURE;
     }
+    const Config_t *config = config_get();
+    if ( config->export_file != NULL && !export_init(config->export_file, config->export_format, config->export_width,
+                                                     config->export_height, config->export_fps) ) {
+        global_finish();
+        return EXIT_FAILURE;
+    }
     Karaoke_t *karaoke = karaoke_init();
     do {
     } while ( karaoke_load_loop(karaoke) == 0 );
 
     karaoke_setup(karaoke);
-    do {
-    } while ( karaoke_loop(karaoke) == 0 );
+    if ( config->bench_mode ) {
+        bench_run(karaoke);
+    } else if ( config->export_file != NULL ) {
+        succeeded = export_run(karaoke);
+    } else {
+        do {
+        } while ( karaoke_loop(karaoke) == 0 );
+    }
 
     karaoke_finish(karaoke);
+    if ( config->export_file != NULL ) {
+        export_finish();
+    }
 #endif
 
     global_finish();
-    return EXIT_SUCCESS;
+    return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -4,9 +4,12 @@
 
 #include "renderer.h"
 
+#include "clock.h"
 #include "constants.h"
 #include "error.h"
 #include "events.h"
+#include "jobs.h"
+#include "trace.h"
 
 #include "contrib/stb_image.h"
 #include "contrib/stb_truetype.h"
@@ -42,11 +45,290 @@
 #define MAX_SHADER_SIZE (1 * 1024 * 1024)
 #define QUAD_VERTICES_SIZE (4 /*points*/ * 3 /*vertices per triangle*/ * 2 /*triangles*/)
 #define PROJECTION_MATRIX_SIZE (16)
+// Glyph atlas dimensions. The width is fixed and the height doubles on demand up to the max
+#define GLYPH_ATLAS_WIDTH (1024)
+#define GLYPH_ATLAS_INITIAL_HEIGHT (256)
+#define GLYPH_ATLAS_MAX_HEIGHT (4096)
+// Empty space left around each glyph so that linear filtering never bleeds into a neighbour
+#define GLYPH_ATLAS_PADDING (1)
+// Must be a power of two
+#define GLYPH_CACHE_INITIAL_CAPACITY (256)
+// Distance field glyphs are always rasterized at this size and resampled to whatever size the text is made with
+#define SDF_REFERENCE_PIXELS (48)
+// How far (in pixels at the reference size) the distance field extends outside of the glyph outline
+#define SDF_PADDING (6)
+// Value stored at the glyph outline. Anything above it is inside the glyph
+#define SDF_ON_EDGE_VALUE (128)
+// Limits for the dual filter blur. Past the maximum offset the taps start to skip over texels
+#define BLUR_MAX_LEVELS (6)
+#define BLUR_MAX_OFFSET (3.f)
+// Must be powers of two
+#define GLYPH_METRICS_INITIAL_CAPACITY (512)
+#define KERNING_CACHE_INITIAL_CAPACITY (1024)
+// Limits on the GPU textures kept around for reuse after being destroyed
+#define TEXTURE_POOL_MAX_ENTRIES (64)
+#define TEXTURE_POOL_MAX_BYTES (64 * 1024 * 1024)
+#define FRAMEBUFFER_POOL_SIZE (8)
+// Sprites the batch has room for at first, doubling whenever it runs out
+#define SPRITE_BATCH_INITIAL_CAPACITY (256)
+// Flags of every sprite, must match the ones in sprite.vert.glsl and texture.frag.glsl
+#define SPRITE_FLAG_SDF (1 << 0)
+#define SPRITE_FLAG_SINGLE_CHANNEL (1 << 1)
+#define SPRITE_FLAG_GLYPH (1 << 2)
+#define SPRITE_FLAG_SHADOW (1 << 3)
+#define SPRITE_FLAG_SHADOW_ERASE (1 << 4)
+// Draw and erase regions the uniform buffer of the sprite batch holds, must match texture.frag.glsl. 16KB is as big as
+// uniform blocks are guaranteed to get
+#define SPRITE_MAX_REGIONS (1024)
+#define SPRITE_REGIONS_BINDING (0)
+
+// How long to wait for events instead of presenting when a frame had nothing new to show
+#define SKIPPED_FRAME_WAIT_SECONDS (1.0 / 60.0)
+// Extra room around the area a texture is measured to cover, for its antialiased edges and the padding of glyph quads
+#define TEXTURE_AREA_MARGIN (2.0)
+// Timer queries a frame can use while GPU timing is on, past which the rest of the frame goes unmeasured
+#define GPU_TIMER_MAX_QUERIES (256)
+// How many frames the GPU timings are kept for
+#define GPU_TIMER_HISTORY (120)
+
+/**
+ * A single glyph rasterized into the atlas, identified by the font, codepoint and pixel size it was rendered with,
+ * and whether it holds coverage or a signed distance field
+ */
+typedef struct AtlasGlyph_t {
+    bool used;
+    FontType_t font;
+    int32_t codepoint;
+    int32_t pixels;
+    bool sdf;
+    // Region of the atlas occupied by the glyph bitmap
+    int32_t x, y, w, h;
+    // Offset of the bitmap relative to the pen position on the baseline
+    int32_t x_off, y_off;
+} AtlasGlyph_t;
+
+/**
+ * Coverage atlas shared by all text rendered with stb_truetype. Glyphs are packed in shelves (rows) from top to bottom
+ * and are only ever rasterized once per font, codepoint and size.
+ * A CPU copy of the coverage is kept so text bitmaps can be composed without reading anything back from the GPU
+ */
+typedef struct GlyphAtlas_t {
+    unsigned char *pixels;
+    int32_t width, height;
+    // Current shelf the packer is filling
+    int32_t shelf_x, shelf_y, shelf_h;
+    // Open addressing hash table of the cached glyphs
+    AtlasGlyph_t *glyphs;
+    size_t capacity, count;
+    // GPU copy of the atlas (single channel) and the rows that still need to be uploaded to it
+    GLuint texture;
+    int32_t texture_height;
+    int32_t dirty_y0, dirty_y1;
+    // Bumped every time the atlas is reset, which invalidates the placement of every glyph handed out before it
+    uint32_t generation;
+} GlyphAtlas_t;
+
+/**
+ * A GPU texture whose owner was destroyed, kept along with the size and format of its storage so it can be handed out again
+ */
+typedef struct PooledTexture_t {
+    GLuint id;
+    int32_t width, height;
+    GLenum format;
+} PooledTexture_t;
+
+/**
+ * Textures and framebuffers that are no longer used, kept so that making render targets and uploading text (which happens
+ * all the time while starting up, resizing and scrolling through the lyrics) reuses them instead of going to the driver.
+ * Textures are only reused for the exact same size and format and the ones released the longest ago are deleted first once
+ * there's too many of them
+ */
+typedef struct TexturePool_t {
+    // Oldest first
+    PooledTexture_t textures[TEXTURE_POOL_MAX_ENTRIES];
+    int32_t num_textures;
+    size_t texture_bytes;
+    GLuint framebuffers[FRAMEBUFFER_POOL_SIZE];
+    int32_t num_framebuffers;
+} TexturePool_t;
+
+/**
+ * A glyph of a run, placed by its pen position on the baseline relative to the top left corner of the run
+ */
+typedef struct RunGlyph_t {
+    int32_t codepoint;
+    float pen_x, baseline_y;
+} RunGlyph_t;
+
+/**
+ * Quad of a single glyph of a run, in pixels relative to the top left corner of the run, and the rectangle of the atlas it
+ * samples, in texels
+ */
+typedef struct GlyphQuad_t {
+    float x0, y0, x1, y1;
+    float u0, v0, u1, v1;
+} GlyphQuad_t;
+
+/**
+ * Text laid out as individual glyphs, drawn as quads that sample the glyph atlas directly instead of a texture of its own.
+ * The quads are rebuilt whenever the atlas is reset
+ */
+struct GlyphRun_t {
+    FontType_t font_type;
+    int32_t pixels_size;
+    bool sdf;
+    RunGlyph_t *glyphs;
+    size_t count, capacity;
+    // Quads of the glyphs with anything to draw and the atlas generation they were built against
+    OWNING GlyphQuad_t *quads;
+    int32_t num_quads;
+    uint32_t atlas_generation;
+};
+
+/**
+ * A single quad drawn by the sprite batch, laid out exactly as the instanced attributes of sprite.vert.glsl
+ */
+typedef struct SpriteInstance_t {
+    // x, y, width and height on screen, in pixels
+    float quad[4];
+    // Rectangle of the texture sampled, in texels
+    float uv[4];
+    // Rectangle of the whole texture (or text) covered, from 0 to 1
+    float region[4];
+    // Color of single channel textures and alpha
+    float color[4];
+    // Color mod factor, border radius, shadow softness and flags
+    float params[4];
+    // Shadow offset, shadow expansion and the size of the whole texture (or text)
+    float extra[4];
+    // First draw region in the uniform buffer and how many there are, and the same for the erase regions
+    float region_range[4];
+} SpriteInstance_t;
+
+/**
+ * Texture draws collected so that consecutive ones sampling the same texture go out in a single instanced draw call.
+ * Sprites are never reordered since they're blended on top of each other, so a batch only lasts while the texture stays the
+ * same and nothing else gets drawn in between. Regions of every sprite go in a uniform buffer uploaded along with the batch
+ */
+typedef struct SpriteBatch_t {
+    GLuint vao;
+    GLuint instance_vbo;
+    OWNING SpriteInstance_t *instances;
+    size_t count, capacity;
+    GLuint texture;
+    int32_t texture_width, texture_height;
+    GLuint regions_ubo;
+    float regions[SPRITE_MAX_REGIONS][4];
+    int32_t num_regions;
+    // Where the last set of regions added starts, so that the draws repeating it can share it
+    int32_t last_regions_first, last_regions_count;
+} SpriteBatch_t;
+
+/**
+ * Mirror of the bits of GL state the renderer keeps changing, as last set through the gl_* functions, so that setting them
+ * to what they already are never reaches the driver. Only ever touched through those functions
+ */
+typedef struct GlState_t {
+    GLuint program;
+    // Bound to GL_TEXTURE_2D of texture unit 0, the only one used
+    GLuint texture;
+    GLuint vertex_array;
+    GLuint array_buffer;
+    GLuint framebuffer;
+    GLint viewport[4];
+    bool scissor_enabled;
+    GLint scissor[4];
+    bool blend_enabled;
+    GLenum blend_src, blend_dst;
+    // How many changes were dropped for setting the state to what it already was
+    uint64_t elided_changes;
+} GlState_t;
+
+/**
+ * Timer queries issued during a single frame, along with the pass each one measured
+ */
+typedef struct GpuTimerFrame_t {
+    GLuint queries[GPU_TIMER_MAX_QUERIES];
+    RenderPass_t passes[GPU_TIMER_MAX_QUERIES];
+    int32_t count;
+} GpuTimerFrame_t;
+
+/**
+ * Measures the GPU time of every pass of a frame. Only one timer query can run at a time, so one runs from every change of
+ * pass to the next. The queries of a frame are only read once the frame after it ends, by which point they're usually done
+ */
+typedef struct GpuTimer_t {
+    bool enabled;
+    // Set while render_clear runs, which draws textures and into render targets of its own
+    bool drawing_background;
+    // Pass measured by the query running, RENDER_PASS_COUNT if there's none
+    RenderPass_t active;
+    GpuTimerFrame_t frames[2];
+    // Index into frames of the one being recorded
+    int32_t current;
+    // Nanoseconds spent in every pass on each of the last frames, as a ring buffer
+    uint64_t history[GPU_TIMER_HISTORY][RENDER_PASS_COUNT];
+    int32_t history_next, history_count;
+} GpuTimer_t;
+
+/**
+ * Reads back every frame presented through two pixel buffers taking turns: a frame is read into one while the other, read
+ * into a frame earlier and done by now, is handed out, so the CPU never waits on the GPU to finish drawing
+ */
+typedef struct FrameCapture_t {
+    WEAK MAYBE_NULL RenderCaptureFunc_t func;
+    WEAK void *user_data;
+    int32_t width, height;
+    GLuint buffers[2];
+    // Whether a buffer holds a frame that wasn't handed out yet
+    bool pending[2];
+    // Index into buffers of the one the next frame is read into
+    int32_t next;
+} FrameCapture_t;
+
+static const char *const GPU_PASS_NAMES[RENDER_PASS_COUNT] = {
+    "background", "shadows", "text", "rects", "images", "offscreen", "present",
+};
+
+/**
+ * Horizontal metrics (in font units) of a single codepoint, along with the glyph it maps to
+ */
+typedef struct GlyphMetrics_t {
+    bool used;
+    int32_t codepoint;
+    int glyph_index;
+    int advance, lsb;
+} GlyphMetrics_t;
+
+/**
+ * Kerning (in font units) between two glyphs, with both glyph indices packed in a single key
+ */
+typedef struct KerningPair_t {
+    bool used;
+    uint32_t glyphs;
+    int kerning;
+} KerningPair_t;
+
+/**
+ * Metrics of a loaded font, cached so that measuring text doesn't have to go through the font tables for every character.
+ * Both tables are seeded when the font is loaded and fill in any codepoints or pairs not seeded on their first lookup
+ */
+typedef struct FontMetrics_t {
+    int units_per_em;
+    int ascent, descent, line_gap;
+    bool has_kerning;
+    // Open addressing hash tables
+    GlyphMetrics_t *glyphs;
+    size_t glyphs_capacity, glyphs_count;
+    KerningPair_t *kerning;
+    size_t kerning_capacity, kerning_count;
+} FontMetrics_t;
 
 typedef struct Renderer_t {
     GLFWwindow *window;
     Bounds_t viewport;
     stbtt_fontinfo ui_font_info, lyrics_font_info;
+    FontMetrics_t ui_font_metrics, lyrics_font_metrics;
     unsigned char *ui_font_data, *lyrics_font_data;
     double h_dpi, v_dpi;
     Color_t bg_color, bg_color_secondary;
@@ -55,12 +337,37 @@ typedef struct Renderer_t {
     bool rendering_to_fbo;
     double window_pixel_scale;
     Texture_t *bg_texture;
+    // The picture of the animated background drawn before bg_texture, which it fades out of while bg_update_interval > 1
+    Texture_t *bg_previous_texture;
+    int32_t bg_resolution_divisor;
+    int32_t bg_update_interval;
+    int32_t bg_frames_since_update;
     BackgroundType_t bg_type;
     float dynamic_bg_colors[5][3];
     bool dynamic_bg_colors_initialized;
+    GlyphAtlas_t glyph_atlas;
+    TexturePool_t texture_pool;
+    SpriteBatch_t sprite_batch;
+    GlState_t gl_state;
+    GpuTimer_t gpu_timer;
+    FrameCapture_t capture;
+    uint64_t next_texture_serial;
+
+    // Everything meant for the screen is drawn here first and copied over when presenting, so that the previous frame is
+    // still around to only redraw what changed on top of it (see render_set_clip)
+    GLuint frame_fbo;
+    GLuint frame_texture;
+    // Whether the frame texture holds a whole frame drawn at the current size and with the current background
+    bool frame_complete;
+    // Whether anything was drawn since the last present, which has nothing to show otherwise
+    bool frame_drawn;
+    // Drawing for no one to see, which never waits on vsync or for events to come
+    bool headless;
+    // Area of the screen drawing is restricted to, in window coordinates (origin at the bottom left)
+    bool clip_enabled;
+    GLint clip[4];
 
     // OpenGL objects
-    GLuint active_shader_program;
     GLuint texture_shader;
     GLuint rect_shader;
     GLuint gradient_shader;
@@ -70,21 +377,16 @@ typedef struct Renderer_t {
     GLuint rand_gradient_shader;
     GLuint blur_shader;
     GLuint copy_shader;
+    // Unit quad shared by everything drawn as a single quad, placed and sized by the vertex shader
+    GLuint quad_vao;
+    GLuint quad_vbo;
     float projection_matrix[PROJECTION_MATRIX_SIZE];
 
     // Shader uniform locations
     GLint tex_projection_loc;
-    GLint tex_alpha_loc;
-    GLint tex_use_bounds_loc;
-    GLint tex_bounds_loc;
-    GLint tex_border_radius_loc;
-    GLint tex_rect_size_loc;
-    GLint tex_color_mod_loc;
-    GLint tex_num_regions_loc;
-    GLint tex_regions_loc;
-    GLint tex_num_erase_regions_loc;
-    GLint tex_erase_regions_loc;
+    GLint tex_texture_size_loc;
     GLint rect_projection_loc;
+    GLint rect_quad_loc;
     GLint rect_color_loc;
     GLint rect_pos_loc;
     GLint rect_size_loc;
@@ -92,11 +394,14 @@ typedef struct Renderer_t {
     GLint gradient_top_color_loc;
     GLint gradient_bottom_color_loc;
     GLint gradient_projection_loc;
+    GLint gradient_quad_loc;
     GLint frost_time_loc;
     GLint blur_texture_loc;
-    GLint blur_direction_loc;
-    GLint blur_size_loc;
+    GLint blur_upsample_loc;
+    GLint blur_half_texel_loc;
+    GLint blur_offset_loc;
     GLint blur_projection_loc;
+    GLint blur_quad_loc;
     GLint rand_grad_time_loc;
     GLint rand_grad_resolution_loc;
     GLint dyn_grad_time_loc;
@@ -132,88 +437,1023 @@ static GLuint compile_shader(const GLenum type, const char *source, const char *
         error_abort("Shader compilation failed");
     }
 
-    return shader;
+    return shader;
+}
+
+static char *begin_shader_compilation(void) {
+    char *buffer = calloc(1, MAX_SHADER_SIZE);
+    if ( buffer == NULL ) {
+        error_abort("Failed to allocate shader compilation buffer");
+    }
+    return buffer;
+}
+
+static const char *process_shader_file(char *buffer, const char *contents) {
+    snprintf(buffer, MAX_SHADER_SIZE, "%s\n%s\n%s", GLSL_VERSION, GLSL_PRECISION, contents);
+    return buffer;
+}
+
+static void end_shader_compilation(char *buff) { free(buff); }
+
+static GLuint create_shader_program(char *buffer, const char *vert_src, const char *frag_src, const char *program_name) {
+    const GLuint vertex = compile_shader(GL_VERTEX_SHADER, process_shader_file(buffer, vert_src), program_name);
+    const GLuint fragment = compile_shader(GL_FRAGMENT_SHADER, process_shader_file(buffer, frag_src), program_name);
+
+    const GLuint program = glCreateProgram();
+    glAttachShader(program, vertex);
+    glAttachShader(program, fragment);
+    glLinkProgram(program);
+
+    GLint success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if ( !success ) {
+        char log[512];
+        glGetProgramInfoLog(program, 512, NULL, log);
+        printf("Shader linking failed for %s:\n%s\n", program_name, log);
+        error_abort("Shader linking failed");
+    }
+
+    glDeleteShader(vertex);
+    glDeleteShader(fragment);
+
+    return program;
+}
+
+static void create_orthographic_matrix(const float left, const float right, const float bottom, const float top, float *matrix) {
+    memset(matrix, 0, PROJECTION_MATRIX_SIZE * sizeof(float));
+    matrix[0] = 2.0f / (right - left);
+    matrix[5] = 2.0f / (top - bottom);
+    matrix[10] = -1.0f;
+    matrix[12] = -(right + left) / (right - left);
+    matrix[13] = -(top + bottom) / (top - bottom);
+    matrix[15] = 1.0f;
+}
+
+static void gl_state_init(GlState_t *state) {
+    // Defaults of a new context, except for the viewport which starts out at the size of the window and is always set before
+    // drawing anyway
+    memset(state, 0, sizeof(*state));
+    state->viewport[2] = state->viewport[3] = -1;
+    state->blend_src = GL_ONE;
+    state->blend_dst = GL_ZERO;
+}
+
+static void gl_use_program(const GLuint program) {
+    GlState_t *state = &g_renderer->gl_state;
+    if ( state->program == program ) {
+        state->elided_changes++;
+        return;
+    }
+    glUseProgram(program);
+    state->program = program;
+}
+
+static void gl_bind_texture(const GLuint texture) {
+    GlState_t *state = &g_renderer->gl_state;
+    if ( state->texture == texture ) {
+        state->elided_changes++;
+        return;
+    }
+    glBindTexture(GL_TEXTURE_2D, texture);
+    state->texture = texture;
+}
+
+static void gl_bind_vertex_array(const GLuint vertex_array) {
+    GlState_t *state = &g_renderer->gl_state;
+    if ( state->vertex_array == vertex_array ) {
+        state->elided_changes++;
+        return;
+    }
+    glBindVertexArray(vertex_array);
+    state->vertex_array = vertex_array;
+}
+
+static void gl_bind_array_buffer(const GLuint buffer) {
+    GlState_t *state = &g_renderer->gl_state;
+    if ( state->array_buffer == buffer ) {
+        state->elided_changes++;
+        return;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    state->array_buffer = buffer;
+}
+
+static void gl_bind_framebuffer(const GLuint framebuffer) {
+    GlState_t *state = &g_renderer->gl_state;
+    if ( state->framebuffer == framebuffer ) {
+        state->elided_changes++;
+        return;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    state->framebuffer = framebuffer;
+}
+
+static void gl_set_viewport(const GLint x, const GLint y, const GLint width, const GLint height) {
+    GlState_t *state = &g_renderer->gl_state;
+    if ( state->viewport[0] == x && state->viewport[1] == y && state->viewport[2] == width && state->viewport[3] == height ) {
+        state->elided_changes++;
+        return;
+    }
+    glViewport(x, y, width, height);
+    state->viewport[0] = x;
+    state->viewport[1] = y;
+    state->viewport[2] = width;
+    state->viewport[3] = height;
+}
+
+/**
+ * Restricts drawing to the given box (x, y, width and height, from the bottom left) or lifts the restriction when it's NULL
+ */
+static void gl_set_scissor(MAYBE_NULL const GLint *box) {
+    GlState_t *state = &g_renderer->gl_state;
+    const bool enabled = box != NULL;
+    if ( state->scissor_enabled != enabled ) {
+        if ( enabled ) {
+            glEnable(GL_SCISSOR_TEST);
+        } else {
+            glDisable(GL_SCISSOR_TEST);
+        }
+        state->scissor_enabled = enabled;
+    } else {
+        state->elided_changes++;
+    }
+    if ( !enabled ) {
+        return;
+    }
+    if ( memcmp(state->scissor, box, sizeof(state->scissor)) != 0 ) {
+        glScissor(box[0], box[1], box[2], box[3]);
+        memcpy(state->scissor, box, sizeof(state->scissor));
+    } else {
+        state->elided_changes++;
+    }
+}
+
+/**
+ * Enables blending with the given factors, or disables it altogether when enabled is false, in which case the factors are
+ * left as they were
+ */
+static void gl_set_blend(const bool enabled, const GLenum src, const GLenum dst) {
+    GlState_t *state = &g_renderer->gl_state;
+    if ( state->blend_enabled != enabled ) {
+        if ( enabled ) {
+            glEnable(GL_BLEND);
+        } else {
+            glDisable(GL_BLEND);
+        }
+        state->blend_enabled = enabled;
+    } else {
+        state->elided_changes++;
+    }
+    if ( !enabled ) {
+        return;
+    }
+    if ( state->blend_src != src || state->blend_dst != dst ) {
+        glBlendFunc(src, dst);
+        state->blend_src = src;
+        state->blend_dst = dst;
+    } else {
+        state->elided_changes++;
+    }
+}
+
+/**
+ * Deleting objects unbinds them, and their names are up for grabs again right after, so the mirror has to forget them too
+ */
+static void gl_delete_textures(const GLsizei count, const GLuint *textures) {
+    GlState_t *state = &g_renderer->gl_state;
+    for ( GLsizei i = 0; i < count; i++ ) {
+        if ( textures[i] == state->texture ) {
+            state->texture = 0;
+        }
+    }
+    glDeleteTextures(count, textures);
+}
+
+static void gl_delete_framebuffers(const GLsizei count, const GLuint *framebuffers) {
+    GlState_t *state = &g_renderer->gl_state;
+    for ( GLsizei i = 0; i < count; i++ ) {
+        if ( framebuffers[i] == state->framebuffer ) {
+            state->framebuffer = 0;
+        }
+    }
+    glDeleteFramebuffers(count, framebuffers);
+}
+
+static void gl_delete_vertex_array(const GLuint vertex_array) {
+    GlState_t *state = &g_renderer->gl_state;
+    if ( vertex_array == state->vertex_array ) {
+        state->vertex_array = 0;
+    }
+    glDeleteVertexArrays(1, &vertex_array);
+}
+
+static void gl_delete_buffer(const GLuint buffer) {
+    GlState_t *state = &g_renderer->gl_state;
+    if ( buffer == state->array_buffer ) {
+        state->array_buffer = 0;
+    }
+    glDeleteBuffers(1, &buffer);
+}
+
+/**
+ * Sets up the layout of the vertices of the bound vertex array object: a position followed by a texture coordinate, both vec2
+ */
+static void configure_vertex_layout(void) {
+    // Position attribute (location 0)
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), NULL);
+
+    // TexCoord attribute (location 1)
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *)(2 * sizeof(float)));
+}
+
+static void create_unit_quad(void) {
+    // Two triangles covering (0, 0) to (1, 1), with texture coordinates matching the position so that (0, 0) is the top left
+    // of whatever is drawn. The vertex shader stretches it to the bounds being drawn or, for the full screen quad shaders,
+    // to the whole clip space
+    static const float vertices[QUAD_VERTICES_SIZE] = {0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f,
+                                                       0.0f, 1.0f, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f};
+
+    glGenVertexArrays(1, &g_renderer->quad_vao);
+    glGenBuffers(1, &g_renderer->quad_vbo);
+
+    gl_bind_vertex_array(g_renderer->quad_vao);
+    gl_bind_array_buffer(g_renderer->quad_vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    configure_vertex_layout();
+}
+
+/**
+ * Draws the unit quad with whatever shader program is active, which must have been given where to place it
+ */
+static void draw_unit_quad(void) {
+    gl_bind_vertex_array(g_renderer->quad_vao);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+}
+
+static void update_projection_matrix(void) {
+    const float w = (float)g_renderer->viewport.w;
+    const float h = (float)g_renderer->viewport.h;
+
+    create_orthographic_matrix(0.f, w, h, 0.f, g_renderer->projection_matrix);
+}
+
+static float *get_projection_matrix(void) {
+    if ( g_renderer->render_target == NULL ) {
+        return g_renderer->projection_matrix;
+    }
+    return g_renderer->render_target->projection;
+}
+
+static void flush_sprite_batch(void);
+
+static void set_shader_program(const GLuint program) {
+    if ( program != g_renderer->texture_shader ) {
+        // Anything drawn with the other programs has to land on top of the sprites queued so far
+        flush_sprite_batch();
+    }
+    gl_use_program(program);
+}
+
+static void gpu_timer_stop(void) {
+#ifndef __EMSCRIPTEN__
+    GpuTimer_t *timer = &g_renderer->gpu_timer;
+    if ( timer->active != RENDER_PASS_COUNT ) {
+        glEndQuery(GL_TIME_ELAPSED);
+        timer->active = RENDER_PASS_COUNT;
+    }
+#endif
+}
+
+/**
+ * Measures the GPU work from here on as part of the given pass, unless it goes to the background or a render target
+ */
+static void gpu_timer_switch(RenderPass_t pass) {
+#ifndef __EMSCRIPTEN__
+    GpuTimer_t *timer = &g_renderer->gpu_timer;
+    if ( !timer->enabled ) {
+        return;
+    }
+    if ( timer->drawing_background ) {
+        pass = RENDER_PASS_BACKGROUND;
+    } else if ( g_renderer->render_target != NULL ) {
+        pass = RENDER_PASS_OFFSCREEN;
+    }
+    if ( pass == timer->active ) {
+        return;
+    }
+
+    // The sprites still queued belong to the pass being ended
+    flush_sprite_batch();
+    gpu_timer_stop();
+
+    GpuTimerFrame_t *frame = &timer->frames[timer->current];
+    if ( frame->count == GPU_TIMER_MAX_QUERIES ) {
+        return;
+    }
+    frame->passes[frame->count] = pass;
+    glBeginQuery(GL_TIME_ELAPSED, frame->queries[frame->count]);
+    frame->count++;
+    timer->active = pass;
+#else
+    (void)pass;
+#endif
+}
+
+/**
+ * Ends the frame being recorded and reads back the one recorded before it, whose queries are reused for the next frame
+ */
+static void gpu_timer_end_frame(void) {
+#ifndef __EMSCRIPTEN__
+    GpuTimer_t *timer = &g_renderer->gpu_timer;
+    if ( !timer->enabled || timer->frames[timer->current].count == 0 ) {
+        return;
+    }
+    gpu_timer_stop();
+    timer->current ^= 1;
+
+    GpuTimerFrame_t *frame = &timer->frames[timer->current];
+    if ( frame->count == 0 ) {
+        return;
+    }
+
+    // Queries finish in order, so the last one being done means they all are. If it isn't even after a whole frame, the
+    // frame is dropped rather than waiting for it
+    GLint available = 0;
+    glGetQueryObjectiv(frame->queries[frame->count - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if ( available ) {
+        uint64_t *times = timer->history[timer->history_next];
+        memset(times, 0, sizeof(timer->history[0]));
+        for ( int32_t i = 0; i < frame->count; i++ ) {
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(frame->queries[i], GL_QUERY_RESULT, &elapsed);
+            times[frame->passes[i]] += elapsed;
+        }
+        timer->history_next = (timer->history_next + 1) % GPU_TIMER_HISTORY;
+        timer->history_count = MIN(timer->history_count + 1, GPU_TIMER_HISTORY);
+    }
+    frame->count = 0;
+#endif
+}
+
+static void sprite_batch_init(SpriteBatch_t *batch) {
+    memset(batch, 0, sizeof(*batch));
+    glGenVertexArrays(1, &batch->vao);
+    glGenBuffers(1, &batch->instance_vbo);
+
+    gl_bind_vertex_array(batch->vao);
+    gl_bind_array_buffer(g_renderer->quad_vbo);
+    configure_vertex_layout();
+
+    // Every vec4 of SpriteInstance_t is an attribute of its own, starting at location 2 and advancing once per instance
+    gl_bind_array_buffer(batch->instance_vbo);
+    for ( GLuint i = 0; i < sizeof(SpriteInstance_t) / (4 * sizeof(float)); i++ ) {
+        glEnableVertexAttribArray(2 + i);
+        glVertexAttribPointer(2 + i, 4, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance_t), (void *)(i * 4 * sizeof(float)));
+        glVertexAttribDivisor(2 + i, 1);
+    }
+
+    glGenBuffers(1, &batch->regions_ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, batch->regions_ubo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(batch->regions), NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, SPRITE_REGIONS_BINDING, batch->regions_ubo);
+}
+
+static void sprite_batch_destroy(SpriteBatch_t *batch) {
+    gl_delete_vertex_array(batch->vao);
+    gl_delete_buffer(batch->instance_vbo);
+    gl_delete_buffer(batch->regions_ubo);
+    free(batch->instances);
+    memset(batch, 0, sizeof(*batch));
+}
+
+/**
+ * Draws every sprite queued so far in a single instanced draw call
+ */
+static void flush_sprite_batch(void) {
+    SpriteBatch_t *batch = &g_renderer->sprite_batch;
+    if ( batch->count == 0 ) {
+        return;
+    }
+
+    set_shader_program(g_renderer->texture_shader);
+    glUniformMatrix4fv(g_renderer->tex_projection_loc, 1, GL_FALSE, get_projection_matrix());
+    glUniform2f(g_renderer->tex_texture_size_loc, (float)batch->texture_width, (float)batch->texture_height);
+    if ( batch->num_regions > 0 ) {
+        // Orphan the previous contents rather than waiting for the draws still reading them
+        glBindBuffer(GL_UNIFORM_BUFFER, batch->regions_ubo);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(batch->regions), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, (GLsizeiptr)((size_t)batch->num_regions * sizeof(batch->regions[0])),
+                        batch->regions);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    gl_bind_texture(batch->texture);
+    gl_bind_vertex_array(batch->vao);
+    gl_bind_array_buffer(batch->instance_vbo);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(batch->count * sizeof(SpriteInstance_t)), batch->instances, GL_STREAM_DRAW);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, (GLsizei)batch->count);
+
+    batch->count = 0;
+    batch->num_regions = 0;
+    batch->last_regions_first = batch->last_regions_count = 0;
+}
+
+/**
+ * Gets the batch ready for sprites sampling the given texture, first drawing whatever was queued if it samples another one
+ */
+static void sprite_batch_prepare(const GLuint texture, const int32_t width, const int32_t height) {
+    SpriteBatch_t *batch = &g_renderer->sprite_batch;
+    if ( batch->texture != texture || batch->texture_width != width || batch->texture_height != height ) {
+        flush_sprite_batch();
+    }
+
+    batch->texture = texture;
+    batch->texture_width = width;
+    batch->texture_height = height;
+}
+
+/**
+ * Adds a set of regions to the uniform buffer of the batch, which must have room for them, returning the index of the first one
+ */
+static int32_t sprite_batch_add_regions(const float (*regions)[4], const int32_t count) {
+    SpriteBatch_t *batch = &g_renderer->sprite_batch;
+    if ( count == 0 ) {
+        return 0;
+    }
+    if ( count == batch->last_regions_count &&
+         memcmp(batch->regions[batch->last_regions_first], regions, (size_t)count * sizeof(*regions)) == 0 ) {
+        return batch->last_regions_first;
+    }
+    const int32_t first = batch->num_regions;
+    memcpy(batch->regions[first], regions, (size_t)count * sizeof(*regions));
+    batch->num_regions += count;
+    batch->last_regions_first = first;
+    batch->last_regions_count = count;
+    return first;
+}
+
+/**
+ * Points the sprite to its regions in the uniform buffer of the batch, drawing whatever was queued first if there's no room
+ * left for them, so this must be done before queueing the sprites that use them
+ */
+static void sprite_set_regions(SpriteInstance_t *sprite, const float (*regions)[4], const int32_t num_regions,
+                               const float (*erase_regions)[4], const int32_t num_erase_regions) {
+    if ( g_renderer->sprite_batch.num_regions + num_regions + num_erase_regions > SPRITE_MAX_REGIONS ) {
+        flush_sprite_batch();
+    }
+    sprite->region_range[0] = (float)sprite_batch_add_regions(regions, num_regions);
+    sprite->region_range[1] = (float)num_regions;
+    sprite->region_range[2] = (float)sprite_batch_add_regions(erase_regions, num_erase_regions);
+    sprite->region_range[3] = (float)num_erase_regions;
+}
+
+static SpriteInstance_t *sprite_batch_push(void) {
+    SpriteBatch_t *batch = &g_renderer->sprite_batch;
+    if ( batch->count == batch->capacity ) {
+        const size_t new_capacity = batch->capacity == 0 ? SPRITE_BATCH_INITIAL_CAPACITY : batch->capacity * 2;
+        SpriteInstance_t *new_instances = realloc(batch->instances, new_capacity * sizeof(*new_instances));
+        if ( new_instances == NULL ) {
+            error_abort("Failed to grow the sprite batch");
+        }
+        batch->instances = new_instances;
+        batch->capacity = new_capacity;
+    }
+    return &batch->instances[batch->count++];
+}
+
+static size_t glyph_hash(const FontType_t font, const int32_t codepoint, const int32_t pixels, const bool sdf) {
+    uint32_t hash = (uint32_t)codepoint * 2654435761u;
+    hash ^= (uint32_t)pixels * 40503u + 0x9e3779b9u + (hash << 6) + (hash >> 2);
+    hash ^= (uint32_t)font * 97u + (sdf ? 0x5bd1e995u : 0u);
+    return hash;
+}
+
+static AtlasGlyph_t *glyph_atlas_find_slot(AtlasGlyph_t *glyphs, const size_t capacity, const FontType_t font,
+                                           const int32_t codepoint, const int32_t pixels, const bool sdf) {
+    size_t index = glyph_hash(font, codepoint, pixels, sdf) & (capacity - 1);
+    while ( glyphs[index].used ) {
+        const AtlasGlyph_t *glyph = &glyphs[index];
+        if ( glyph->codepoint == codepoint && glyph->pixels == pixels && glyph->font == font && glyph->sdf == sdf ) {
+            break;
+        }
+        index = (index + 1) & (capacity - 1);
+    }
+    return &glyphs[index];
+}
+
+static void glyph_atlas_grow_table(GlyphAtlas_t *atlas) {
+    const size_t new_capacity = atlas->capacity == 0 ? GLYPH_CACHE_INITIAL_CAPACITY : atlas->capacity * 2;
+    AtlasGlyph_t *new_glyphs = calloc(new_capacity, sizeof(*new_glyphs));
+    if ( new_glyphs == NULL ) {
+        error_abort("Failed to allocate glyph cache");
+    }
+
+    for ( size_t i = 0; i < atlas->capacity; i++ ) {
+        const AtlasGlyph_t *glyph = &atlas->glyphs[i];
+        if ( glyph->used ) {
+            *glyph_atlas_find_slot(new_glyphs, new_capacity, glyph->font, glyph->codepoint, glyph->pixels, glyph->sdf) = *glyph;
+        }
+    }
+
+    free(atlas->glyphs);
+    atlas->glyphs = new_glyphs;
+    atlas->capacity = new_capacity;
+}
+
+static void glyph_atlas_mark_dirty(GlyphAtlas_t *atlas, const int32_t y0, const int32_t y1) {
+    if ( atlas->dirty_y1 <= atlas->dirty_y0 ) {
+        atlas->dirty_y0 = y0;
+        atlas->dirty_y1 = y1;
+    } else {
+        atlas->dirty_y0 = MIN(atlas->dirty_y0, y0);
+        atlas->dirty_y1 = MAX(atlas->dirty_y1, y1);
+    }
+}
+
+static void glyph_atlas_reset(GlyphAtlas_t *atlas) {
+    if ( atlas->glyphs != NULL ) {
+        memset(atlas->glyphs, 0, atlas->capacity * sizeof(*atlas->glyphs));
+    }
+    atlas->count = 0;
+    atlas->generation++;
+    atlas->shelf_x = atlas->shelf_y = atlas->shelf_h = 0;
+    if ( atlas->pixels != NULL ) {
+        memset(atlas->pixels, 0, (size_t)atlas->width * atlas->height);
+        glyph_atlas_mark_dirty(atlas, 0, atlas->height);
+    }
+}
+
+static void glyph_atlas_destroy(GlyphAtlas_t *atlas) {
+    if ( atlas->texture != 0 ) {
+        gl_delete_textures(1, &atlas->texture);
+    }
+    free(atlas->pixels);
+    free(atlas->glyphs);
+    memset(atlas, 0, sizeof(*atlas));
+}
+
+static size_t texture_storage_bytes(const int32_t width, const int32_t height, const GLenum format) {
+    return (size_t)width * (size_t)height * (format == GL_R8 ? 1 : 4);
+}
+
+/**
+ * Returns a texture with storage for width by height texels of the given format (GL_R8 or GL_RGBA), with linear filtering
+ * and clamped to its edges. Its contents are undefined, so it must be cleared or fully uploaded to before being used
+ */
+static GLuint texture_pool_acquire(const int32_t width, const int32_t height, const GLenum format) {
+    TexturePool_t *pool = &g_renderer->texture_pool;
+
+    // Newest first, since those are the most likely to be the same thing being made again
+    for ( int32_t i = pool->num_textures - 1; i >= 0; i-- ) {
+        const PooledTexture_t *entry = &pool->textures[i];
+        if ( entry->width != width || entry->height != height || entry->format != format )
+            continue;
+
+        const GLuint id = entry->id;
+        pool->texture_bytes -= texture_storage_bytes(width, height, format);
+        memmove(&pool->textures[i], &pool->textures[i + 1], (size_t)(pool->num_textures - i - 1) * sizeof(*entry));
+        pool->num_textures--;
+        return id;
+    }
+
+    GLuint id;
+    glGenTextures(1, &id);
+    gl_bind_texture(id);
+    const GLenum upload_format = format == GL_R8 ? GL_RED : GL_RGBA;
+    glTexImage2D(GL_TEXTURE_2D, 0, (GLint)format, width, height, 0, upload_format, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return id;
+}
+
+static void texture_pool_release(const GLuint id, const int32_t width, const int32_t height, const GLenum format) {
+    TexturePool_t *pool = &g_renderer->texture_pool;
+    const size_t bytes = texture_storage_bytes(width, height, format);
+    if ( bytes > TEXTURE_POOL_MAX_BYTES / 4 ) {
+        // Not worth holding on to something this big on the off chance the exact same size comes up again
+        gl_delete_textures(1, &id);
+        return;
+    }
+
+    while ( pool->num_textures > 0 &&
+            (pool->num_textures >= TEXTURE_POOL_MAX_ENTRIES || pool->texture_bytes + bytes > TEXTURE_POOL_MAX_BYTES) ) {
+        const PooledTexture_t *oldest = &pool->textures[0];
+        gl_delete_textures(1, &oldest->id);
+        pool->texture_bytes -= texture_storage_bytes(oldest->width, oldest->height, oldest->format);
+        memmove(&pool->textures[0], &pool->textures[1], (size_t)(pool->num_textures - 1) * sizeof(*oldest));
+        pool->num_textures--;
+    }
+
+    pool->textures[pool->num_textures++] = (PooledTexture_t){.id = id, .width = width, .height = height, .format = format};
+    pool->texture_bytes += bytes;
+}
+
+static GLuint framebuffer_pool_acquire(void) {
+    TexturePool_t *pool = &g_renderer->texture_pool;
+    if ( pool->num_framebuffers > 0 ) {
+        return pool->framebuffers[--pool->num_framebuffers];
+    }
+
+    GLuint fbo;
+    glGenFramebuffers(1, &fbo);
+    return fbo;
+}
+
+/**
+ * Must be called with the framebuffer bound, so its texture can be detached and deleted later on without the pool keeping
+ * it alive
+ */
+static void framebuffer_pool_release(const GLuint fbo) {
+    TexturePool_t *pool = &g_renderer->texture_pool;
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+    if ( pool->num_framebuffers < FRAMEBUFFER_POOL_SIZE ) {
+        pool->framebuffers[pool->num_framebuffers++] = fbo;
+    } else {
+        gl_delete_framebuffers(1, &fbo);
+    }
+}
+
+static void texture_pool_destroy(TexturePool_t *pool) {
+    for ( int32_t i = 0; i < pool->num_textures; i++ ) {
+        gl_delete_textures(1, &pool->textures[i].id);
+    }
+    if ( pool->num_framebuffers > 0 ) {
+        gl_delete_framebuffers(pool->num_framebuffers, pool->framebuffers);
+    }
+    memset(pool, 0, sizeof(*pool));
+}
+
+/**
+ * Finds space for a w by h bitmap using a simple shelf packer. Grows the atlas (doubling its height) when it runs out of
+ * shelves and starts over from an empty atlas (bumping its generation) once it's at the maximum size
+ */
+static void glyph_atlas_allocate(GlyphAtlas_t *atlas, const int32_t w, const int32_t h, int32_t *out_x, int32_t *out_y) {
+    const int32_t padded_w = w + GLYPH_ATLAS_PADDING, padded_h = h + GLYPH_ATLAS_PADDING;
+    if ( padded_w > atlas->width || padded_h > GLYPH_ATLAS_MAX_HEIGHT ) {
+        error_abort("Glyph is too large to fit in the atlas");
+    }
+
+    if ( atlas->shelf_x + padded_w > atlas->width ) {
+        // Start a new shelf below the current one
+        atlas->shelf_y += atlas->shelf_h;
+        atlas->shelf_x = 0;
+        atlas->shelf_h = 0;
+    }
+
+    while ( atlas->shelf_y + padded_h > atlas->height ) {
+        if ( atlas->height >= GLYPH_ATLAS_MAX_HEIGHT ) {
+            // Text bitmaps already have their own copy of the glyphs and glyph runs rebuild their quads once they notice
+            // the generation changed, so it's safe to start over
+            glyph_atlas_reset(atlas);
+            break;
+        }
+
+        const int32_t new_height = atlas->height * 2;
+        unsigned char *new_pixels = realloc(atlas->pixels, (size_t)atlas->width * new_height);
+        if ( new_pixels == NULL ) {
+            error_abort("Failed to grow the glyph atlas");
+        }
+        memset(new_pixels + (size_t)atlas->width * atlas->height, 0, (size_t)atlas->width * (new_height - atlas->height));
+        atlas->pixels = new_pixels;
+        atlas->height = new_height;
+    }
+
+    *out_x = atlas->shelf_x;
+    *out_y = atlas->shelf_y;
+    atlas->shelf_x += padded_w;
+    atlas->shelf_h = MAX(atlas->shelf_h, padded_h);
+}
+
+/**
+ * Rasterizes a single glyph into a newly allocated bitmap (freed with free_glyph_bitmap), filling in its dimensions and offsets.
+ * Returns NULL for glyphs with nothing to draw. Distance field glyphs store values relative to SDF_ON_EDGE_VALUE instead of
+ * coverage and include SDF_PADDING around them.
+ * Only ever reads from the font, so it's safe to call from the job workers
+ */
+static unsigned char *rasterize_glyph(const FontType_t font_type, const int32_t codepoint, const int32_t pixels, const bool sdf,
+                                      AtlasGlyph_t *out_glyph) {
+    const stbtt_fontinfo *font = font_type == FONT_UI ? &g_renderer->ui_font_info : &g_renderer->lyrics_font_info;
+    const float scale = stbtt_ScaleForMappingEmToPixels(font, (float)pixels);
+
+    *out_glyph = (AtlasGlyph_t){.used = true, .font = font_type, .codepoint = codepoint, .pixels = pixels, .sdf = sdf};
+
+    unsigned char *bitmap;
+    if ( sdf ) {
+        bitmap = stbtt_GetCodepointSDF(font, scale, codepoint, SDF_PADDING, SDF_ON_EDGE_VALUE, (float)SDF_ON_EDGE_VALUE / SDF_PADDING,
+                                       &out_glyph->w, &out_glyph->h, &out_glyph->x_off, &out_glyph->y_off);
+    } else {
+        bitmap = stbtt_GetCodepointBitmap(font, scale, scale, codepoint, &out_glyph->w, &out_glyph->h, &out_glyph->x_off,
+                                          &out_glyph->y_off);
+    }
+
+    if ( bitmap == NULL || out_glyph->w <= 0 || out_glyph->h <= 0 ) {
+        out_glyph->w = out_glyph->h = 0;
+    }
+    return bitmap;
+}
+
+static void free_glyph_bitmap(unsigned char *bitmap, const bool sdf) {
+    if ( bitmap == NULL )
+        return;
+    if ( sdf ) {
+        stbtt_FreeSDF(bitmap, NULL);
+    } else {
+        stbtt_FreeBitmap(bitmap, NULL);
+    }
+}
+
+/**
+ * Returns the glyph if it's already in the atlas, NULL otherwise
+ */
+static const AtlasGlyph_t *glyph_atlas_lookup(const FontType_t font_type, const int32_t codepoint, const int32_t pixels,
+                                              const bool sdf) {
+    GlyphAtlas_t *atlas = &g_renderer->glyph_atlas;
+    if ( atlas->capacity == 0 ) {
+        return NULL;
+    }
+    const AtlasGlyph_t *glyph = glyph_atlas_find_slot(atlas->glyphs, atlas->capacity, font_type, codepoint, pixels, sdf);
+    return glyph->used ? glyph : NULL;
+}
+
+/**
+ * Copies a glyph rasterized by rasterize_glyph into the atlas and adds it to the cache
+ */
+static const AtlasGlyph_t *glyph_atlas_insert(AtlasGlyph_t glyph, const unsigned char *bitmap) {
+    GlyphAtlas_t *atlas = &g_renderer->glyph_atlas;
+    if ( atlas->pixels == NULL ) {
+        atlas->width = GLYPH_ATLAS_WIDTH;
+        atlas->height = GLYPH_ATLAS_INITIAL_HEIGHT;
+        atlas->pixels = calloc(1, (size_t)atlas->width * atlas->height);
+        if ( atlas->pixels == NULL ) {
+            error_abort("Failed to allocate the glyph atlas");
+        }
+    }
+    // Keep the load factor under 3/4
+    if ( (atlas->count + 1) * 4 > atlas->capacity * 3 ) {
+        glyph_atlas_grow_table(atlas);
+    }
+
+    if ( glyph.w > 0 && glyph.h > 0 ) {
+        // May reset the atlas to make room, so the slot is only looked up after this
+        glyph_atlas_allocate(atlas, glyph.w, glyph.h, &glyph.x, &glyph.y);
+        unsigned char *dest = atlas->pixels + (size_t)glyph.y * atlas->width + glyph.x;
+        for ( int32_t y = 0; y < glyph.h; y++ ) {
+            memcpy(dest + (size_t)y * atlas->width, bitmap + (size_t)y * glyph.w, glyph.w);
+        }
+        glyph_atlas_mark_dirty(atlas, glyph.y, glyph.y + glyph.h);
+    }
+
+    AtlasGlyph_t *slot = glyph_atlas_find_slot(atlas->glyphs, atlas->capacity, glyph.font, glyph.codepoint, glyph.pixels, glyph.sdf);
+    *slot = glyph;
+    atlas->count++;
+    return slot;
+}
+
+/**
+ * Returns the cached glyph for the given codepoint, rasterizing it into the atlas on the first use
+ */
+static const AtlasGlyph_t *glyph_atlas_get(const FontType_t font_type, const int32_t codepoint, const int32_t pixels,
+                                           const bool sdf) {
+    const AtlasGlyph_t *cached = glyph_atlas_lookup(font_type, codepoint, pixels, sdf);
+    if ( cached != NULL ) {
+        return cached;
+    }
+
+    AtlasGlyph_t glyph;
+    unsigned char *bitmap = rasterize_glyph(font_type, codepoint, pixels, sdf, &glyph);
+    const AtlasGlyph_t *result = glyph_atlas_insert(glyph, bitmap);
+    free_glyph_bitmap(bitmap, sdf);
+    return result;
+}
+
+/**
+ * Uploads the rows of the atlas that changed since the last call to its GPU texture
+ */
+static void glyph_atlas_flush(void) {
+    GlyphAtlas_t *atlas = &g_renderer->glyph_atlas;
+    if ( atlas->pixels == NULL ) {
+        return;
+    }
+
+    const bool grown = atlas->texture == 0 || atlas->texture_height != atlas->height;
+    if ( !grown && atlas->dirty_y1 <= atlas->dirty_y0 ) {
+        return;
+    }
+    // Glyphs queued for drawing must see the atlas as it was when they were placed, it might have been reset since
+    flush_sprite_batch();
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if ( grown ) {
+        if ( atlas->texture == 0 ) {
+            glGenTextures(1, &atlas->texture);
+        }
+        gl_bind_texture(atlas->texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, atlas->width, atlas->height, 0, GL_RED, GL_UNSIGNED_BYTE, atlas->pixels);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        atlas->texture_height = atlas->height;
+    } else {
+        gl_bind_texture(atlas->texture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, atlas->dirty_y0, atlas->width, atlas->dirty_y1 - atlas->dirty_y0, GL_RED,
+                        GL_UNSIGNED_BYTE, atlas->pixels + (size_t)atlas->dirty_y0 * atlas->width);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    atlas->dirty_y0 = atlas->dirty_y1 = 0;
+}
+
+static const stbtt_fontinfo *get_font_info(const FontType_t type) {
+    return type == FONT_UI ? &g_renderer->ui_font_info : &g_renderer->lyrics_font_info;
+}
+
+static FontMetrics_t *get_font_metrics(const FontType_t type) {
+    return type == FONT_UI ? &g_renderer->ui_font_metrics : &g_renderer->lyrics_font_metrics;
+}
+
+/**
+ * Same as stbtt_ScaleForMappingEmToPixels, without reading the font header every time
+ */
+static float font_get_scale(const FontMetrics_t *metrics, const int32_t pixels) {
+    return (float)pixels / (float)metrics->units_per_em;
+}
+
+static GlyphMetrics_t *font_find_glyph_slot(GlyphMetrics_t *glyphs, const size_t capacity, const int32_t codepoint) {
+    size_t index = ((uint32_t)codepoint * 2654435761u) & (capacity - 1);
+    while ( glyphs[index].used && glyphs[index].codepoint != codepoint ) {
+        index = (index + 1) & (capacity - 1);
+    }
+    return &glyphs[index];
+}
+
+static KerningPair_t *font_find_kerning_slot(KerningPair_t *pairs, const size_t capacity, const uint32_t glyphs) {
+    size_t index = (glyphs * 2654435761u) & (capacity - 1);
+    while ( pairs[index].used && pairs[index].glyphs != glyphs ) {
+        index = (index + 1) & (capacity - 1);
+    }
+    return &pairs[index];
+}
+
+static void font_grow_glyphs(FontMetrics_t *metrics) {
+    const size_t new_capacity = metrics->glyphs_capacity == 0 ? GLYPH_METRICS_INITIAL_CAPACITY : metrics->glyphs_capacity * 2;
+    GlyphMetrics_t *new_glyphs = calloc(new_capacity, sizeof(*new_glyphs));
+    if ( new_glyphs == NULL ) {
+        error_abort("Failed to allocate glyph metrics");
+    }
+    for ( size_t i = 0; i < metrics->glyphs_capacity; i++ ) {
+        if ( metrics->glyphs[i].used ) {
+            *font_find_glyph_slot(new_glyphs, new_capacity, metrics->glyphs[i].codepoint) = metrics->glyphs[i];
+        }
+    }
+    free(metrics->glyphs);
+    metrics->glyphs = new_glyphs;
+    metrics->glyphs_capacity = new_capacity;
+}
+
+static void font_grow_kerning(FontMetrics_t *metrics) {
+    const size_t new_capacity = metrics->kerning_capacity == 0 ? KERNING_CACHE_INITIAL_CAPACITY : metrics->kerning_capacity * 2;
+    KerningPair_t *new_pairs = calloc(new_capacity, sizeof(*new_pairs));
+    if ( new_pairs == NULL ) {
+        error_abort("Failed to allocate kerning cache");
+    }
+    for ( size_t i = 0; i < metrics->kerning_capacity; i++ ) {
+        if ( metrics->kerning[i].used ) {
+            *font_find_kerning_slot(new_pairs, new_capacity, metrics->kerning[i].glyphs) = metrics->kerning[i];
+        }
+    }
+    free(metrics->kerning);
+    metrics->kerning = new_pairs;
+    metrics->kerning_capacity = new_capacity;
+}
+
+/**
+ * Returns the metrics of the given codepoint. The result is a copy since the table may be reallocated by later lookups
+ */
+static GlyphMetrics_t font_get_glyph_metrics(FontMetrics_t *metrics, const stbtt_fontinfo *info, const int32_t codepoint) {
+    // Keep the load factor under 3/4
+    if ( (metrics->glyphs_count + 1) * 4 > metrics->glyphs_capacity * 3 ) {
+        font_grow_glyphs(metrics);
+    }
+
+    GlyphMetrics_t *glyph = font_find_glyph_slot(metrics->glyphs, metrics->glyphs_capacity, codepoint);
+    if ( !glyph->used ) {
+        glyph->used = true;
+        glyph->codepoint = codepoint;
+        glyph->glyph_index = stbtt_FindGlyphIndex(info, codepoint);
+        stbtt_GetGlyphHMetrics(info, glyph->glyph_index, &glyph->advance, &glyph->lsb);
+        metrics->glyphs_count++;
+    }
+    return *glyph;
 }
 
-static char *begin_shader_compilation(void) {
-    char *buffer = calloc(1, MAX_SHADER_SIZE);
-    if ( buffer == NULL ) {
-        error_abort("Failed to allocate shader compilation buffer");
+/**
+ * Returns the kerning between two glyphs (not codepoints)
+ */
+static int font_get_kerning(FontMetrics_t *metrics, const stbtt_fontinfo *info, const int glyph1, const int glyph2) {
+    if ( !metrics->has_kerning ) {
+        return 0;
+    }
+    if ( (metrics->kerning_count + 1) * 4 > metrics->kerning_capacity * 3 ) {
+        font_grow_kerning(metrics);
     }
-    return buffer;
-}
 
-static const char *process_shader_file(char *buffer, const char *contents) {
-    snprintf(buffer, MAX_SHADER_SIZE, "%s\n%s\n%s", GLSL_VERSION, GLSL_PRECISION, contents);
-    return buffer;
+    const uint32_t key = (uint32_t)glyph1 << 16 | ((uint32_t)glyph2 & 0xFFFF);
+    KerningPair_t *pair = font_find_kerning_slot(metrics->kerning, metrics->kerning_capacity, key);
+    if ( !pair->used ) {
+        pair->used = true;
+        pair->glyphs = key;
+        pair->kerning = stbtt_GetGlyphKernAdvance(info, glyph1, glyph2);
+        metrics->kerning_count++;
+    }
+    return pair->kerning;
 }
 
-static void end_shader_compilation(char *buff) { free(buff); }
+static void font_metrics_destroy(FontMetrics_t *metrics) {
+    free(metrics->glyphs);
+    free(metrics->kerning);
+    memset(metrics, 0, sizeof(*metrics));
+}
 
-static GLuint create_shader_program(char *buffer, const char *vert_src, const char *frag_src, const char *program_name) {
-    const GLuint vertex = compile_shader(GL_VERTEX_SHADER, process_shader_file(buffer, vert_src), program_name);
-    const GLuint fragment = compile_shader(GL_FRAGMENT_SHADER, process_shader_file(buffer, frag_src), program_name);
+/**
+ * Rebuilds the cached metrics for a freshly loaded font.
+ * Advances are seeded for ASCII, Latin-1 and kana. Fonts that only have a legacy kern table get all of its pairs up front,
+ * while GPOS fonts (which stb can't enumerate) get every pair of printable ASCII characters
+ */
+static void font_metrics_build(FontMetrics_t *metrics, const stbtt_fontinfo *info) {
+    font_metrics_destroy(metrics);
 
-    const GLuint program = glCreateProgram();
-    glAttachShader(program, vertex);
-    glAttachShader(program, fragment);
-    glLinkProgram(program);
+    metrics->units_per_em = (int)lroundf(1.f / stbtt_ScaleForMappingEmToPixels(info, 1.f));
+    stbtt_GetFontVMetrics(info, &metrics->ascent, &metrics->descent, &metrics->line_gap);
+    metrics->has_kerning = info->kern != 0 || info->gpos != 0;
 
-    GLint success;
-    glGetProgramiv(program, GL_LINK_STATUS, &success);
-    if ( !success ) {
-        char log[512];
-        glGetProgramInfoLog(program, 512, NULL, log);
-        printf("Shader linking failed for %s:\n%s\n", program_name, log);
-        error_abort("Shader linking failed");
+    static const int32_t seed_ranges[][2] = {{0x20, 0x7E}, {0xA0, 0xFF}, {0x3040, 0x30FF}};
+    for ( size_t r = 0; r < sizeof(seed_ranges) / sizeof(seed_ranges[0]); r++ ) {
+        for ( int32_t c = seed_ranges[r][0]; c <= seed_ranges[r][1]; c++ ) {
+            font_get_glyph_metrics(metrics, info, c);
+        }
     }
 
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
+    if ( !metrics->has_kerning ) {
+        return;
+    }
 
-    return program;
+    if ( info->gpos == 0 ) {
+        const int length = stbtt_GetKerningTableLength(info);
+        if ( length > 0 ) {
+            stbtt_kerningentry *table = malloc(length * sizeof(*table));
+            if ( table == NULL ) {
+                error_abort("Failed to allocate kerning table");
+            }
+            stbtt_GetKerningTable(info, table, length);
+            for ( int i = 0; i < length; i++ ) {
+                font_get_kerning(metrics, info, table[i].glyph1, table[i].glyph2);
+            }
+            free(table);
+        }
+    } else {
+        for ( int32_t a = 0x20; a <= 0x7E; a++ ) {
+            const int glyph1 = font_get_glyph_metrics(metrics, info, a).glyph_index;
+            for ( int32_t b = 0x20; b <= 0x7E; b++ ) {
+                font_get_kerning(metrics, info, glyph1, font_get_glyph_metrics(metrics, info, b).glyph_index);
+            }
+        }
+    }
 }
 
-static void create_orthographic_matrix(const float left, const float right, const float bottom, const float top, float *matrix) {
-    memset(matrix, 0, PROJECTION_MATRIX_SIZE * sizeof(float));
-    matrix[0] = 2.0f / (right - left);
-    matrix[5] = 2.0f / (top - bottom);
-    matrix[10] = -1.0f;
-    matrix[12] = -(right + left) / (right - left);
-    matrix[13] = -(top + bottom) / (top - bottom);
-    matrix[15] = 1.0f;
-}
+/**
+ * Measures the width in pixels of a single line of text at the given scale, including kerning
+ */
+static int measure_text_line_width(const FontType_t font_type, const char *text, const int32_t len, const float scale) {
+    const stbtt_fontinfo *font = get_font_info(font_type);
+    FontMetrics_t *metrics = get_font_metrics(font_type);
 
-static void create_quad_vertices(const float x, const float y, const float w, const float h, float *dest_vertices) {
-    const float vertices[] = {x, (y + h), 0.0f, 1.0f, x,       y, 0.0f, 0.0f, (x + w), y,       1.0f, 0.0f,
-                              x, (y + h), 0.0f, 1.0f, (x + w), y, 1.0f, 0.0f, (x + w), (y + h), 1.0f, 1.0f};
+    int width = 0;
+    int32_t i = 0;
+    int32_t c = 0;
+    int prev_glyph = -1;
 
-    memcpy(dest_vertices, vertices, sizeof(vertices));
-}
+    while ( i < len ) {
+        // U8_NEXT(text, i, len, c);
+        c = str_u8_next(text, len, &i);
+        if ( c < 0 )
+            continue;
 
-static void update_projection_matrix(void) {
-    const float w = (float)g_renderer->viewport.w;
-    const float h = (float)g_renderer->viewport.h;
+        const GlyphMetrics_t glyph = font_get_glyph_metrics(metrics, font, c);
 
-    create_orthographic_matrix(0.f, w, h, 0.f, g_renderer->projection_matrix);
-}
+        if ( prev_glyph != -1 ) {
+            width += font_get_kerning(metrics, font, prev_glyph, glyph.glyph_index);
+        }
 
-static void set_shader_program(const GLuint program) {
-    if ( g_renderer->active_shader_program != program ) {
-        glUseProgram(program);
-        g_renderer->active_shader_program = program;
+        width += glyph.advance;
+        prev_glyph = glyph.glyph_index;
     }
-}
-
-static bool texture_needs_reconfigure(const Texture_t *texture, const Bounds_t *at) {
-    return texture->buf_w != at->w || texture->buf_h != at->h || texture->buf_x != at->x || texture->buf_y != at->y;
-}
-
-static void mark_texture_configured(Texture_t *texture, const Bounds_t *at) {
-    texture->buf_x = (int32_t)at->x;
-    texture->buf_y = (int32_t)at->y;
-    texture->buf_w = (int32_t)at->w;
-    texture->buf_h = (int32_t)at->h;
+    return (int)(width * (double)scale);
 }
 
 #ifdef __EMSCRIPTEN__
@@ -231,7 +1471,57 @@ static EM_BOOL on_web_resize(const int eventType, const EmscriptenUiEvent *uiEve
 }
 #endif
 
-void render_init(void) {
+static void frame_cache_destroy(void) {
+    if ( g_renderer->frame_fbo != 0 ) {
+        gl_delete_framebuffers(1, &g_renderer->frame_fbo);
+        gl_delete_textures(1, &g_renderer->frame_texture);
+        g_renderer->frame_fbo = g_renderer->frame_texture = 0;
+    }
+    g_renderer->frame_complete = false;
+}
+
+/**
+ * (Re)creates the frame everything meant for the screen is drawn into, leaving it bound. Without one (say, the window is
+ * minimized) drawing goes straight to the window
+ */
+static void frame_cache_create(const int32_t width, const int32_t height) {
+    frame_cache_destroy();
+    if ( width > 0 && height > 0 ) {
+        glGenTextures(1, &g_renderer->frame_texture);
+        gl_bind_texture(g_renderer->frame_texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glGenFramebuffers(1, &g_renderer->frame_fbo);
+        gl_bind_framebuffer(g_renderer->frame_fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, g_renderer->frame_texture, 0);
+    }
+    gl_bind_framebuffer(g_renderer->frame_fbo);
+}
+
+static bool background_is_animated(void) {
+    if ( !g_renderer->dynamic_bg_colors_initialized ) {
+        // Solid color until the colors are sampled (see render_clear)
+        return false;
+    }
+    const BackgroundType_t type = g_renderer->bg_type;
+    return type == BACKGROUND_SANDS_GRADIENT || type == BACKGROUND_RANDOM_GRADIENT || type == BACKGROUND_AM_LIKE_GRADIENT ||
+           type == BACKGROUND_CLOUD_GRADIENT;
+}
+
+static void destroy_bg_textures(void) {
+    if ( g_renderer->bg_texture != NULL ) {
+        render_destroy_texture(g_renderer->bg_texture);
+        g_renderer->bg_texture = NULL;
+    }
+    if ( g_renderer->bg_previous_texture != NULL ) {
+        render_destroy_texture(g_renderer->bg_previous_texture);
+        g_renderer->bg_previous_texture = NULL;
+    }
+}
+
+void render_init(const bool headless) {
     if ( g_renderer != NULL ) {
         printf("Warning: renderer already initialized\n");
         return;
@@ -241,6 +1531,10 @@ void render_init(void) {
     if ( g_renderer == NULL ) {
         error_abort("Failed to allocate renderer");
     }
+    g_renderer->bg_resolution_divisor = 1;
+    g_renderer->bg_update_interval = 1;
+    g_renderer->gpu_timer.active = RENDER_PASS_COUNT;
+    g_renderer->headless = headless;
 
 #ifdef __EMSCRIPTEN__
     glfwWindowHint(GLFW_CLIENT_API, GLFW_OPENGL_ES_API);
@@ -261,6 +1555,9 @@ void render_init(void) {
     glfwWindowHint(GLFW_DOUBLEBUFFER, GLFW_TRUE);
     glfwWindowHint(GLFW_DEPTH_BITS, 24);
     glfwWindowHint(GLFW_SCALE_TO_MONITOR, GLFW_TRUE);
+    if ( headless ) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    }
 
     g_renderer->window = glfwCreateWindow(width, height, DEFAULT_TITLE, NULL, NULL);
     if ( g_renderer->window == NULL ) {
@@ -286,11 +1583,12 @@ void render_init(void) {
         error_abort("Failed to initialize GLEW");
     }
     glGetError();
-    glfwSwapInterval(1);
+    glfwSwapInterval(headless ? 0 : 1);
 #else
     emscripten_set_resize_callback(EMSCRIPTEN_EVENT_TARGET_WINDOW, NULL, false, on_web_resize);
 #endif
 
+    gl_state_init(&g_renderer->gl_state);
     g_renderer->bg_color = (Color_t){0, 0, 0, 255};
     g_renderer->bg_type = BACKGROUND_NONE;
 
@@ -303,7 +1601,7 @@ void render_init(void) {
 
     // Compile shaders
     char *buffer = begin_shader_compilation();
-    g_renderer->texture_shader = create_shader_program(buffer, incbin_default_vert_shader, incbin_texture_frag_shader, "tex");
+    g_renderer->texture_shader = create_shader_program(buffer, incbin_sprite_vert_shader, incbin_texture_frag_shader, "tex");
     g_renderer->rect_shader = create_shader_program(buffer, incbin_default_vert_shader, incbin_rect_frag_shader, "rect");
     g_renderer->gradient_shader =
         create_shader_program(buffer, incbin_default_vert_shader, incbin_gradient_frag_shader, "gradient");
@@ -319,21 +1617,18 @@ void render_init(void) {
     g_renderer->copy_shader = create_shader_program(buffer, incbin_default_vert_shader, incbin_copy_frag_shader, "copy");
     end_shader_compilation(buffer);
 
+    create_unit_quad();
+    sprite_batch_init(&g_renderer->sprite_batch);
+
     // Get uniform locations for texture shader
     g_renderer->tex_projection_loc = glGetUniformLocation(g_renderer->texture_shader, "u_projection");
-    g_renderer->tex_alpha_loc = glGetUniformLocation(g_renderer->texture_shader, "u_alpha");
-    g_renderer->tex_use_bounds_loc = glGetUniformLocation(g_renderer->texture_shader, "u_use_bounds");
-    g_renderer->tex_bounds_loc = glGetUniformLocation(g_renderer->texture_shader, "u_bounds");
-    g_renderer->tex_border_radius_loc = glGetUniformLocation(g_renderer->texture_shader, "u_borderRadius");
-    g_renderer->tex_rect_size_loc = glGetUniformLocation(g_renderer->texture_shader, "u_rectSize");
-    g_renderer->tex_color_mod_loc = glGetUniformLocation(g_renderer->texture_shader, "u_colorModFactor");
-    g_renderer->tex_num_regions_loc = glGetUniformLocation(g_renderer->texture_shader, "u_num_regions");
-    g_renderer->tex_regions_loc = glGetUniformLocation(g_renderer->texture_shader, "u_regions");
-    g_renderer->tex_num_erase_regions_loc = glGetUniformLocation(g_renderer->texture_shader, "u_num_erase_regions");
-    g_renderer->tex_erase_regions_loc = glGetUniformLocation(g_renderer->texture_shader, "u_erase_regions");
+    g_renderer->tex_texture_size_loc = glGetUniformLocation(g_renderer->texture_shader, "u_textureSize");
+    glUniformBlockBinding(g_renderer->texture_shader, glGetUniformBlockIndex(g_renderer->texture_shader, "SpriteRegions"),
+                          SPRITE_REGIONS_BINDING);
 
     // Get uniform locations for rect shader
     g_renderer->rect_projection_loc = glGetUniformLocation(g_renderer->rect_shader, "u_projection");
+    g_renderer->rect_quad_loc = glGetUniformLocation(g_renderer->rect_shader, "u_quad");
     g_renderer->rect_color_loc = glGetUniformLocation(g_renderer->rect_shader, "u_color");
     g_renderer->rect_pos_loc = glGetUniformLocation(g_renderer->rect_shader, "u_rectPos");
     g_renderer->rect_size_loc = glGetUniformLocation(g_renderer->rect_shader, "u_rectSize");
@@ -343,6 +1638,7 @@ void render_init(void) {
     g_renderer->gradient_top_color_loc = glGetUniformLocation(g_renderer->gradient_shader, "u_topColor");
     g_renderer->gradient_bottom_color_loc = glGetUniformLocation(g_renderer->gradient_shader, "u_bottomColor");
     g_renderer->gradient_projection_loc = glGetUniformLocation(g_renderer->gradient_shader, "u_projection");
+    g_renderer->gradient_quad_loc = glGetUniformLocation(g_renderer->gradient_shader, "u_quad");
 
     // Get uniform locations for the random gradient shader
     g_renderer->rand_grad_time_loc = glGetUniformLocation(g_renderer->rand_gradient_shader, "u_time");
@@ -355,9 +1651,11 @@ void render_init(void) {
 
     // Get uniform locations for blur shader
     g_renderer->blur_texture_loc = glGetUniformLocation(g_renderer->blur_shader, "u_texture");
-    g_renderer->blur_direction_loc = glGetUniformLocation(g_renderer->blur_shader, "u_direction");
-    g_renderer->blur_size_loc = glGetUniformLocation(g_renderer->blur_shader, "u_blur_size");
+    g_renderer->blur_upsample_loc = glGetUniformLocation(g_renderer->blur_shader, "u_upsample");
+    g_renderer->blur_half_texel_loc = glGetUniformLocation(g_renderer->blur_shader, "u_half_texel");
+    g_renderer->blur_offset_loc = glGetUniformLocation(g_renderer->blur_shader, "u_offset");
     g_renderer->blur_projection_loc = glGetUniformLocation(g_renderer->blur_shader, "u_projection");
+    g_renderer->blur_quad_loc = glGetUniformLocation(g_renderer->blur_shader, "u_quad");
 
     // Get uniform locations for the AM-like shader
     g_renderer->aml_resolution_loc = glGetUniformLocation(g_renderer->am_gradient_shader, "iResolution");
@@ -375,8 +1673,19 @@ void render_finish(void) {
         free(g_renderer->ui_font_data);
     if ( g_renderer->lyrics_font_data != NULL )
         free(g_renderer->lyrics_font_data);
+    font_metrics_destroy(&g_renderer->ui_font_metrics);
+    font_metrics_destroy(&g_renderer->lyrics_font_metrics);
 
     // Delete OpenGL objects
+    render_set_gpu_timing(false);
+    render_end_capture();
+    destroy_bg_textures();
+    glyph_atlas_destroy(&g_renderer->glyph_atlas);
+    texture_pool_destroy(&g_renderer->texture_pool);
+    frame_cache_destroy();
+    sprite_batch_destroy(&g_renderer->sprite_batch);
+    gl_delete_vertex_array(g_renderer->quad_vao);
+    gl_delete_buffer(g_renderer->quad_vbo);
     glDeleteProgram(g_renderer->texture_shader);
     glDeleteProgram(g_renderer->rect_shader);
     glDeleteProgram(g_renderer->gradient_shader);
@@ -396,6 +1705,8 @@ void render_finish(void) {
 }
 
 void render_on_window_changed(void) {
+    flush_sprite_batch();
+
     int32_t outW, outH;
     glfwGetFramebufferSize(g_renderer->window, &outW, &outH);
 
@@ -417,16 +1728,22 @@ void render_on_window_changed(void) {
     g_renderer->h_dpi = BASE_DPI * x_scale;
     g_renderer->v_dpi = BASE_DPI * y_scale;
 
+    if ( g_renderer->capture.func != NULL ) {
+        // Frames are drawn offscreen anyway, so they can be captured at any size no matter how big the window is
+        outW = g_renderer->capture.width;
+        outH = g_renderer->capture.height;
+    }
     g_renderer->viewport = (Bounds_t){.x = 0, .y = 0, .w = (double)outW, .h = (double)outH};
 
-    glViewport(0, 0, outW, outH);
+    gl_set_viewport(0, 0, outW, outH);
     update_projection_matrix();
 
+    g_renderer->clip_enabled = false;
+    gl_set_scissor(NULL);
+    frame_cache_create(outW, outH);
+
     // Update background texture
-    if ( g_renderer->bg_texture != NULL ) {
-        render_destroy_texture(g_renderer->bg_texture);
-        g_renderer->bg_texture = NULL;
-    }
+    destroy_bg_textures();
 }
 
 static void deconstruct_colors_opengl(const Color_t *color, float *r, float *g, float *b, float *a) {
@@ -440,36 +1757,16 @@ static void deconstruct_colors_opengl(const Color_t *color, float *r, float *g,
         *a = (float)color->a / 255.0f;
 }
 
-static void draw_random_gradient_bg(void) {
+static void draw_random_gradient_bg(const int32_t width, const int32_t height) {
     const BlendMode_t saved_blend = g_renderer->blend_mode;
     render_set_blend_mode(BLEND_MODE_NONE);
 
-    if ( g_renderer->bg_texture == NULL ) {
-        g_renderer->bg_texture = render_make_null();
-        // At this point, the texture is unconfigured
-    }
-
     set_shader_program(g_renderer->rand_gradient_shader);
-    glBindVertexArray(g_renderer->bg_texture->vao);
-    glBindBuffer(GL_ARRAY_BUFFER, g_renderer->bg_texture->vbo);
-
-    const int32_t width = (int32_t)g_renderer->viewport.w, height = (int32_t)g_renderer->viewport.h;
-    const Bounds_t bounds = {.x = 0, .y = 0, .w = (double)width, .h = (double)height};
-    if ( texture_needs_reconfigure(g_renderer->bg_texture, &bounds) ) {
-        // Update vertex data for the vbo
-        static float quadVertices[] = {-1.0f, 1.0f, 0.0f, 1.0f, -1.0f, -1.0f, 0.0f, 0.0f, 1.0f, -1.0f, 1.0f, 0.0f,
-                                       -1.0f, 1.0f, 0.0f, 1.0f, 1.0f,  -1.0f, 1.0f, 0.0f, 1.0f, 1.0f,  1.0f, 1.0f};
-        glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
-        mark_texture_configured(g_renderer->bg_texture, &bounds);
-    }
 
-    glUniform1f(g_renderer->rand_grad_time_loc, (float)events_get_elapsed_time());
+    glUniform1f(g_renderer->rand_grad_time_loc, (float)clock_frame_time());
     glUniform2f(g_renderer->rand_grad_resolution_loc, (float)width, (float)height);
 
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    draw_unit_quad();
 
     render_set_blend_mode(saved_blend);
 }
@@ -478,30 +1775,13 @@ static void draw_dynamic_gradient_bg(void) {
     const BlendMode_t saved_blend = g_renderer->blend_mode;
     render_set_blend_mode(BLEND_MODE_NONE);
 
-    if ( g_renderer->bg_texture == NULL ) {
-        g_renderer->bg_texture = render_make_null();
-    }
-
     set_shader_program(g_renderer->dyn_gradient_shader);
 
-    glBindVertexArray(g_renderer->bg_texture->vao);
-    glBindBuffer(GL_ARRAY_BUFFER, g_renderer->bg_texture->vbo);
-
-    const int32_t width = (int32_t)g_renderer->viewport.w, height = (int32_t)g_renderer->viewport.h;
-    const Bounds_t bounds = {.x = 0, .y = 0, .w = (double)width, .h = (double)height};
-    if ( texture_needs_reconfigure(g_renderer->bg_texture, &bounds) ) {
-        // Update vertex data for the vbo
-        static float quadVertices[] = {-1.0f, 1.0f, 0.0f, 1.0f, -1.0f, -1.0f, 0.0f, 0.0f, 1.0f, -1.0f, 1.0f, 0.0f,
-                                       -1.0f, 1.0f, 0.0f, 1.0f, 1.0f,  -1.0f, 1.0f, 0.0f, 1.0f, 1.0f,  1.0f, 1.0f};
-        glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
-        mark_texture_configured(g_renderer->bg_texture, &bounds);
-    }
-
-    glUniform1f(g_renderer->dyn_grad_time_loc, (float)events_get_elapsed_time() / 5.f);
+    glUniform1f(g_renderer->dyn_grad_time_loc, (float)clock_frame_time() / 5.f);
     glUniform1f(g_renderer->dyn_grad_noise_mag_loc, 0.1f);
     glUniform3fv(g_renderer->dyn_grad_colors, 5, &g_renderer->dynamic_bg_colors[0][0]);
 
-    glDrawArrays(GL_TRIANGLES, 0, 6);
+    draw_unit_quad();
 
     render_set_blend_mode(saved_blend);
 }
@@ -517,29 +1797,13 @@ static void draw_am_like_bg(const BackgroundType_t type) {
         shader_program = g_renderer->cloud_gradient_shader;
     }
 
-    if ( g_renderer->bg_texture == NULL ) {
-        g_renderer->bg_texture = render_make_null();
-    }
-
     set_shader_program(shader_program);
-    glBindVertexArray(g_renderer->bg_texture->vao);
-    glBindBuffer(GL_ARRAY_BUFFER, g_renderer->bg_texture->vbo);
-
-    const int32_t width = (int32_t)g_renderer->viewport.w, height = (int32_t)g_renderer->viewport.h;
-    const Bounds_t bounds = {.x = 0, .y = 0, .w = (double)width, .h = (double)height};
-    if ( texture_needs_reconfigure(g_renderer->bg_texture, &bounds) ) {
-
-        static float quadVertices[] = {-1.0f, 1.0f, 0.0f, 1.0f, -1.0f, -1.0f, 0.0f, 0.0f, 1.0f, -1.0f, 1.0f, 0.0f,
-                                       -1.0f, 1.0f, 0.0f, 1.0f, 1.0f,  -1.0f, 1.0f, 0.0f, 1.0f, 1.0f,  1.0f, 1.0f};
-        glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
-        mark_texture_configured(g_renderer->bg_texture, &bounds);
-    }
 
-    glUniform1f(g_renderer->aml_time_loc, (float)events_get_elapsed_time());
+    glUniform1f(g_renderer->aml_time_loc, (float)clock_frame_time());
     glUniform3f(g_renderer->aml_resolution_loc, 1.f, 1.f, 0.f);
     glUniform3fv(g_renderer->aml_colors_loc, 5, &g_renderer->dynamic_bg_colors[0][0]);
 
-    glDrawArrays(GL_TRIANGLES, 0, 6);
+    draw_unit_quad();
 
     render_set_blend_mode(saved_blend);
 }
@@ -561,69 +1825,124 @@ static Texture_t *internal_create_gradient_background_texture(void) {
     deconstruct_colors_opengl(&g_renderer->bg_color_secondary, &r, &g, &b, &a);
     glUniform4f(g_renderer->gradient_bottom_color_loc, r, g, b, a);
     glUniformMatrix4fv(g_renderer->gradient_projection_loc, 1, GL_FALSE, target->projection);
+    glUniform4f(g_renderer->gradient_quad_loc, 0.f, 0.f, w, h);
 
-    float quadVertices[QUAD_VERTICES_SIZE] = {0};
-    create_quad_vertices(0, 0, w, h, quadVertices);
-
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glBindVertexArray(target->texture->vao);
-    glBindBuffer(GL_ARRAY_BUFFER, target->texture->vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
+    draw_unit_quad();
 
     Texture_t *texture = render_restore_texture_target();
     render_set_blend_mode(saved_blend);
     return texture;
 }
 
-Texture_t *render_blur_texture(const Texture_t *source, const float blur_radius) {
-    if ( !source || blur_radius <= 0 || source->width <= 0 || source->height <= 0 ) {
-        error_abort("Fail at render_blur_texture_radius");
+/**
+ * Draws the current animated background into a texture at a fraction of the window size
+ */
+static Texture_t *make_animated_bg_texture(void) {
+    const int32_t divisor = g_renderer->bg_resolution_divisor;
+    const int32_t width = MAX(1, (int32_t)g_renderer->viewport.w / divisor);
+    const int32_t height = MAX(1, (int32_t)g_renderer->viewport.h / divisor);
+    render_make_texture_target(width, height);
+
+    if ( g_renderer->bg_type == BACKGROUND_SANDS_GRADIENT ) {
+        draw_dynamic_gradient_bg();
+    } else if ( g_renderer->bg_type == BACKGROUND_RANDOM_GRADIENT ) {
+        draw_random_gradient_bg(width, height);
+    } else {
+        draw_am_like_bg(g_renderer->bg_type);
+    }
+
+    return render_restore_texture_target();
+}
+
+static void draw_animated_bg(void) {
+    const int32_t interval = g_renderer->bg_update_interval;
+    if ( g_renderer->bg_texture == NULL || ++g_renderer->bg_frames_since_update >= interval ) {
+        if ( g_renderer->bg_previous_texture != NULL ) {
+            render_destroy_texture(g_renderer->bg_previous_texture);
+        }
+        g_renderer->bg_previous_texture = g_renderer->bg_texture;
+        g_renderer->bg_texture = make_animated_bg_texture();
+        g_renderer->bg_frames_since_update = 0;
     }
 
     const BlendMode_t saved_blend = g_renderer->blend_mode;
     render_set_blend_mode(BLEND_MODE_NONE);
 
-    const int32_t width = source->width, height = source->height;
-    const RenderTarget_t *first_target = render_make_texture_target(width, height);
+    // The background shaders put the bottom of the picture in the first row, same as the screen, but textures drawn on the
+    // screen start at the top, so draw it upside down
+    const Bounds_t at = {.x = 0, .y = g_renderer->viewport.h, .w = g_renderer->viewport.w, .h = -g_renderer->viewport.h};
+    DrawTextureOpts_t opts = {.alpha_mod = 255, .color_mod = 1.f};
 
-    const float w = (float)source->width;
-    const float h = (float)source->height;
+    if ( interval > 1 && g_renderer->bg_previous_texture != NULL ) {
+        render_draw_texture(g_renderer->bg_previous_texture, &at, &opts);
+        render_set_blend_mode(BLEND_MODE_BLEND);
+        opts.alpha_mod = 255 * (g_renderer->bg_frames_since_update + 1) / interval;
+    }
+    render_draw_texture(g_renderer->bg_texture, &at, &opts);
 
-    set_shader_program(g_renderer->blur_shader);
-    glUniformMatrix4fv(g_renderer->blur_projection_loc, 1, GL_FALSE, first_target->projection);
-    glUniform1f(g_renderer->blur_size_loc, blur_radius);
-    glUniform2f(g_renderer->blur_direction_loc, 1.0f, 0.0f);
+    render_set_blend_mode(saved_blend);
+}
+
+/**
+ * Draws a single pass of the dual filter blur, reading from source into a new texture of the given size
+ */
+static Texture_t *blur_pass(const Texture_t *source, const int32_t width, const int32_t height, const bool upsample) {
+    const RenderTarget_t *target = render_make_texture_target(width, height);
 
-    glBindTexture(GL_TEXTURE_2D, source->id);
+    set_shader_program(g_renderer->blur_shader);
+    glUniformMatrix4fv(g_renderer->blur_projection_loc, 1, GL_FALSE, target->projection);
+    glUniform1i(g_renderer->blur_upsample_loc, upsample);
+    glUniform2f(g_renderer->blur_half_texel_loc, 0.5f / (float)source->width, 0.5f / (float)source->height);
 
-    float vertices[QUAD_VERTICES_SIZE] = {0};
-    create_quad_vertices(0, 0, w, h, vertices);
+    glUniform4f(g_renderer->blur_quad_loc, 0.f, 0.f, (float)width, (float)height);
 
-    glBindVertexArray(first_target->texture->vao);
-    glBindBuffer(GL_ARRAY_BUFFER, first_target->texture->vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), &vertices, GL_STREAM_DRAW);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
+    gl_bind_texture(source->id);
+    draw_unit_quad();
 
-    Texture_t *vertical_texture = render_restore_texture_target();
+    return render_restore_texture_target();
+}
 
-    const RenderTarget_t *second_target = render_make_texture_target(width, height);
+Texture_t *render_blur_texture(const Texture_t *source, const float blur_radius) {
+    if ( !source || blur_radius <= 0 || source->width <= 0 || source->height <= 0 ) {
+        error_abort("Fail at render_blur_texture_radius");
+    }
 
-    glUniform2f(g_renderer->blur_direction_loc, 0.0f, 1.0f);
+    // Every level halves the resolution and about doubles how far the blur reaches, and the offset of the taps covers what's
+    // in between, reaching about offset * 2^levels pixels in the end
+    int32_t levels = 1;
+    while ( levels < BLUR_MAX_LEVELS && (float)(1 << levels) * BLUR_MAX_OFFSET < blur_radius ) {
+        levels++;
+    }
+    while ( levels > 1 && ((source->width >> levels) < 2 || (source->height >> levels) < 2) ) {
+        levels--;
+    }
+    const float offset = fmaxf(1.f, fminf(BLUR_MAX_OFFSET, blur_radius / (float)(1 << levels)));
 
-    glBindTexture(GL_TEXTURE_2D, vertical_texture->id);
-    glBindVertexArray(second_target->texture->vao);
-    glBindBuffer(GL_ARRAY_BUFFER, second_target->texture->vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), &vertices, GL_STREAM_DRAW);
+    const BlendMode_t saved_blend = g_renderer->blend_mode;
+    render_set_blend_mode(BLEND_MODE_NONE);
 
-    glDrawArrays(GL_TRIANGLES, 0, 6);
+    set_shader_program(g_renderer->blur_shader);
+    glUniform1f(g_renderer->blur_offset_loc, offset);
+
+    const Texture_t *current = source;
+    Texture_t *intermediate = NULL;
+    for ( int32_t level = 1 - levels; level <= levels; level++ ) {
+        // Down to the smallest level and then back up to the original size
+        const int32_t shift = levels - abs(level);
+        const bool upsample = level > 0;
+        Texture_t *result = blur_pass(current, MAX(1, source->width >> shift), MAX(1, source->height >> shift), upsample);
+
+        if ( intermediate != NULL ) {
+            render_destroy_texture(intermediate);
+        }
+        intermediate = result;
+        current = result;
+    }
 
-    Texture_t *horizontal_texture = render_restore_texture_target();
-    horizontal_texture->border_radius = source->border_radius;
-    render_destroy_texture(vertical_texture);
+    intermediate->border_radius = source->border_radius;
 
     render_set_blend_mode(saved_blend);
-    return horizontal_texture;
+    return intermediate;
 }
 
 Texture_t *render_blur_texture_replace(Texture_t *source, const float blur_radius) {
@@ -632,7 +1951,7 @@ Texture_t *render_blur_texture_replace(Texture_t *source, const float blur_radiu
     return blurred;
 }
 
-void render_clear(void) {
+static void draw_background(void) {
     // Return early if it's just a solid background, or we haven't initialized all the required params to draw the bg yet
     const bool bg_not_initialized = g_renderer->bg_type != BACKGROUND_GRADIENT && !g_renderer->dynamic_bg_colors_initialized;
     if ( g_renderer->bg_type == BACKGROUND_NONE || bg_not_initialized ) {
@@ -652,16 +1971,127 @@ void render_clear(void) {
         }
         static DrawTextureOpts_t opts = {.alpha_mod = 255, .color_mod = 1.f};
         render_draw_texture(g_renderer->bg_texture, &(Bounds_t){0}, &opts);
-    } else if ( g_renderer->bg_type == BACKGROUND_SANDS_GRADIENT ) {
-        draw_dynamic_gradient_bg();
-    } else if ( g_renderer->bg_type == BACKGROUND_RANDOM_GRADIENT ) {
-        draw_random_gradient_bg();
-    } else if ( g_renderer->bg_type == BACKGROUND_AM_LIKE_GRADIENT || g_renderer->bg_type == BACKGROUND_CLOUD_GRADIENT ) {
-        draw_am_like_bg(g_renderer->bg_type);
+    } else if ( background_is_animated() ) {
+        draw_animated_bg();
+    }
+}
+
+void render_clear(void) {
+    flush_sprite_batch();
+    g_renderer->frame_drawn = true;
+    if ( !g_renderer->clip_enabled ) {
+        g_renderer->frame_complete = true;
+    }
+
+    g_renderer->gpu_timer.drawing_background = true;
+    gpu_timer_switch(RENDER_PASS_BACKGROUND);
+    draw_background();
+    // Send out the background sprites while they're still measured as part of it
+    flush_sprite_batch();
+    g_renderer->gpu_timer.drawing_background = false;
+}
+
+#ifndef __EMSCRIPTEN__
+/**
+ * Hands out the frame in a capture buffer, if it has one
+ */
+static void capture_deliver(const int32_t index) {
+    FrameCapture_t *capture = &g_renderer->capture;
+    if ( !capture->pending[index] ) {
+        return;
+    }
+    capture->pending[index] = false;
+
+    const GLsizeiptr size = (GLsizeiptr)capture->width * capture->height * 4;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->buffers[index]);
+    const uint8_t *pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+    if ( pixels != NULL ) {
+        capture->func(capture->user_data, pixels, capture->width, capture->height);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    } else {
+        fprintf(stderr, "Failed to map a captured frame\n");
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+/**
+ * Starts reading back the frame that was just finished, and hands out the one read back before it
+ */
+static void capture_frame(void) {
+    FrameCapture_t *capture = &g_renderer->capture;
+    if ( capture->func == NULL || g_renderer->frame_fbo == 0 ) {
+        return;
+    }
+
+    const int32_t index = capture->next;
+    gl_bind_framebuffer(g_renderer->frame_fbo);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->buffers[index]);
+    glReadPixels(0, 0, capture->width, capture->height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    capture->pending[index] = true;
+
+    capture->next = 1 - index;
+    capture_deliver(capture->next);
+}
+#endif
+
+void render_present(void) {
+    flush_sprite_batch();
+    g_renderer->clip_enabled = false;
+    gl_set_scissor(NULL);
+
+#ifndef __EMSCRIPTEN__
+    // The frame kept offscreen is whole either way, so frames that skip drawing capture the same picture again
+    capture_frame();
+#endif
+
+    if ( !g_renderer->frame_drawn ) {
+        // What's on screen is still up to date, so just wait about as long as showing a new frame would have
+        gpu_timer_end_frame();
+#ifndef __EMSCRIPTEN__
+        if ( !g_renderer->headless ) {
+            glfwWaitEventsTimeout(SKIPPED_FRAME_WAIT_SECONDS);
+        }
+#endif
+        return;
+    }
+    g_renderer->frame_drawn = false;
+
+    gpu_timer_switch(RENDER_PASS_PRESENT);
+    if ( g_renderer->frame_fbo != 0 ) {
+        const GLint w = (GLint)g_renderer->viewport.w, h = (GLint)g_renderer->viewport.h;
+        gl_bind_framebuffer(g_renderer->frame_fbo);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, w, h, 0, 0, w, h, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, g_renderer->frame_fbo);
     }
+    gpu_timer_end_frame();
+    glfwSwapBuffers(g_renderer->window);
 }
 
-void render_present(void) { glfwSwapBuffers(g_renderer->window); }
+void render_set_clip(const Bounds_t *area) {
+    // Whatever was queued so far still goes under the previous clip
+    flush_sprite_batch();
+    if ( area == NULL ) {
+        g_renderer->clip_enabled = false;
+    } else {
+        const double vw = g_renderer->viewport.w, vh = g_renderer->viewport.h;
+        const GLint x0 = (GLint)floor(fmax(0.0, area->x)), x1 = (GLint)ceil(fmin(vw, area->x + area->w));
+        const GLint y0 = (GLint)floor(fmax(0.0, area->y)), y1 = (GLint)ceil(fmin(vh, area->y + area->h));
+        g_renderer->clip_enabled = true;
+        g_renderer->clip[0] = x0;
+        g_renderer->clip[1] = (GLint)vh - y1;
+        g_renderer->clip[2] = MAX(0, x1 - x0);
+        g_renderer->clip[3] = MAX(0, y1 - y0);
+    }
+    if ( g_renderer->render_target == NULL ) {
+        gl_set_scissor(g_renderer->clip_enabled ? g_renderer->clip : NULL);
+    }
+}
+
+bool render_has_previous_frame(void) {
+    return g_renderer->frame_fbo != 0 && g_renderer->frame_complete && !background_is_animated();
+}
 
 const Bounds_t *render_get_viewport(void) { return &g_renderer->viewport; }
 
@@ -691,47 +2121,24 @@ void render_load_font(const unsigned char *data, const int data_size, const Font
     if ( !stbtt_InitFont(info, data_copy, 0) ) {
         error_abort("Could not load font");
     }
+
+    font_metrics_build(get_font_metrics(type), info);
+
+    // Any glyphs cached for the previous font of this type are no longer valid
+    glyph_atlas_reset(&g_renderer->glyph_atlas);
 }
 
 void render_set_window_title(const char *title) { glfwSetWindowTitle(g_renderer->window, title); }
 
 void render_measure_text_size(const char *text, const int32_t pixels, int32_t *w, int32_t *h, const FontType_t kind) {
-    const stbtt_fontinfo *font = kind == FONT_UI ? &g_renderer->ui_font_info : &g_renderer->lyrics_font_info;
-
-    const float pixel_height = (float)pixels;
-    const float scale = stbtt_ScaleForMappingEmToPixels(font, pixel_height);
-
-    int ascent, descent, lineGap;
-    stbtt_GetFontVMetrics(font, &ascent, &descent, &lineGap);
+    const FontMetrics_t *metrics = get_font_metrics(kind);
+    const float scale = font_get_scale(metrics, pixels);
 
     if ( h )
-        *h = (int32_t)((ascent - descent + lineGap) * (double)scale);
-
-    int width = 0;
-    int32_t i = 0;
-    const int32_t len = (int32_t)strlen(text);
-    int32_t c = 0;
-    int32_t prev_c = -1;
-
-    while ( i < len ) {
-        // U8_NEXT(text, i, len, c);
-        c = str_u8_next(text, len, &i);
-        if ( c < 0 )
-            continue;
-
-        int advance, lsb;
-        stbtt_GetCodepointHMetrics(font, c, &advance, &lsb);
-
-        if ( prev_c != -1 ) {
-            width += stbtt_GetCodepointKernAdvance(font, prev_c, c);
-        }
-
-        width += advance;
-        prev_c = c;
-    }
+        *h = (int32_t)((metrics->ascent - metrics->descent + metrics->line_gap) * (double)scale);
 
     if ( w )
-        *w = (int32_t)(width * (double)scale);
+        *w = measure_text_line_width(kind, text, (int32_t)strlen(text), scale);
 }
 
 int32_t render_measure_pixels_from_em(const double em) {
@@ -749,37 +2156,30 @@ int32_t render_measure_pt_from_em(const double em) {
 
 void render_measure_char_bounds(const int32_t c, const int32_t prev_c, const int32_t pixels, CharBounds_t *out_bounds,
                                 const FontType_t font) {
-    const stbtt_fontinfo *font_info = font == FONT_UI ? &g_renderer->ui_font_info : &g_renderer->lyrics_font_info;
-
-    const float scale = stbtt_ScaleForMappingEmToPixels(font_info, (float)pixels);
+    const stbtt_fontinfo *font_info = get_font_info(font);
+    FontMetrics_t *metrics = get_font_metrics(font);
 
-    int ascent, descent, lineGap;
-    stbtt_GetFontVMetrics(font_info, &ascent, &descent, &lineGap);
+    const float scale = font_get_scale(metrics, pixels);
 
-    const double height = (ascent - descent + lineGap) * (double)scale;
+    const double height = (metrics->ascent - metrics->descent + metrics->line_gap) * (double)scale;
 
-    int advance, lsb;
-    stbtt_GetCodepointHMetrics(font_info, c, &advance, &lsb);
+    const GlyphMetrics_t glyph = font_get_glyph_metrics(metrics, font_info, c);
 
     double kerning = 0.0;
     if ( prev_c > 0 ) {
-        kerning = stbtt_GetCodepointKernAdvance(font_info, prev_c, c);
+        const int prev_glyph = font_get_glyph_metrics(metrics, font_info, prev_c).glyph_index;
+        kerning = font_get_kerning(metrics, font_info, prev_glyph, glyph.glyph_index);
     }
 
     out_bounds->kerning = kerning * (double)scale;
-    out_bounds->advance = advance * (double)scale;
-    out_bounds->width = (kerning + advance) * (double)scale;
+    out_bounds->advance = glyph.advance * (double)scale;
+    out_bounds->width = (kerning + glyph.advance) * (double)scale;
     out_bounds->font_height = height;
 }
 
-static float *get_projection_matrix(void) {
-    if ( g_renderer->render_target == NULL ) {
-        return g_renderer->projection_matrix;
-    }
-    return g_renderer->render_target->projection;
-}
-
 const RenderTarget_t *render_make_texture_target(const int32_t width, const int32_t height) {
+    flush_sprite_batch();
+
     RenderTarget_t *target = calloc(1, sizeof(*target));
     if ( target == NULL ) {
         error_abort("Failed to allocate render target");
@@ -787,36 +2187,28 @@ const RenderTarget_t *render_make_texture_target(const int32_t width, const int3
 
     target->texture = render_make_null();
 
-    const BlendMode_t saved_blend = g_renderer->blend_mode;
-    render_set_blend_mode(BLEND_MODE_NONE);
-
     target->texture->width = width;
     target->texture->height = height;
     target->prev_target = g_renderer->render_target;
     g_renderer->render_target = target;
+    gpu_timer_switch(RENDER_PASS_OFFSCREEN);
 
-    glGenFramebuffers(1, &target->fbo);
-    glBindFramebuffer(GL_FRAMEBUFFER, target->fbo);
+    target->fbo = framebuffer_pool_acquire();
+    gl_bind_framebuffer(target->fbo);
+    // The clip only applies to the screen
+    gl_set_scissor(NULL);
 
-    glGenTextures(1, &target->texture->id);
-
-    glBindTexture(GL_TEXTURE_2D, target->texture->id);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    target->texture->id = texture_pool_acquire(width, height, GL_RGBA);
 
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target->texture->id, 0);
 
-    glViewport(0, 0, width, height);
+    target->viewport[2] = width;
+    target->viewport[3] = height;
+    gl_set_viewport(0, 0, width, height);
 
     create_orthographic_matrix(0.0f, (float)width, 0.0f, (float)height, target->projection);
     glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
-
-    render_set_blend_mode(saved_blend);
+    glClear(GL_COLOR_BUFFER_BIT);
 
     return target;
 }
@@ -825,25 +2217,29 @@ Texture_t *render_restore_texture_target(void) {
     if ( g_renderer->render_target == NULL ) {
         error_abort("No render target to restore");
     }
+    flush_sprite_batch();
 
     RenderTarget_t *current = g_renderer->render_target;
     RenderTarget_t *prev = current->prev_target;
     g_renderer->render_target = prev;
 
+    // Still bound at this point
+    framebuffer_pool_release(current->fbo);
+
     // Bind appropriate framebuffer
     if ( prev == NULL ) {
-        glViewport(0, 0, (int32_t)g_renderer->viewport.w, (int32_t)g_renderer->viewport.h);
-        // Restore default framebuffer
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        gl_set_viewport(0, 0, (int32_t)g_renderer->viewport.w, (int32_t)g_renderer->viewport.h);
+        // Back to drawing to the screen
+        gl_bind_framebuffer(g_renderer->frame_fbo);
+        gl_set_scissor(g_renderer->clip_enabled ? g_renderer->clip : NULL);
     } else {
-        glViewport(prev->viewport[0], prev->viewport[1], prev->viewport[2], prev->viewport[3]);
+        gl_set_viewport(prev->viewport[0], prev->viewport[1], prev->viewport[2], prev->viewport[3]);
         // Bind previous FBO
-        glBindFramebuffer(GL_FRAMEBUFFER, g_renderer->render_target->fbo);
+        gl_bind_framebuffer(g_renderer->render_target->fbo);
     }
 
     Texture_t *texture = current->texture;
 
-    glDeleteFramebuffers(1, &current->fbo);
     // Assume the texture is going to be freed on its own, or else there's no point to making a
     // render target in the first place.
     free(current);
@@ -852,12 +2248,17 @@ Texture_t *render_restore_texture_target(void) {
 }
 
 void render_destroy_texture(Texture_t *texture) {
+    if ( texture->id != 0 && texture->id == g_renderer->sprite_batch.texture ) {
+        // Sprites of it may still be queued, and the pool could hand it out to someone else right away
+        flush_sprite_batch();
+    }
     if ( texture->id != 0 )
-        glDeleteTextures(1, &texture->id);
-    if ( texture->vao != 0 )
-        glDeleteVertexArrays(1, &texture->vao);
-    if ( texture->vbo != 0 )
-        glDeleteBuffers(1, &texture->vbo);
+        texture_pool_release(texture->id, texture->width, texture->height, texture->single_channel ? GL_R8 : GL_RGBA);
+    if ( texture->glyph_run != NULL ) {
+        free(texture->glyph_run->quads);
+        free(texture->glyph_run->glyphs);
+        free(texture->glyph_run);
+    }
     free(texture);
 }
 
@@ -879,12 +2280,22 @@ Color_t render_color_darken(Color_t color, const double amount) {
 void render_set_bg_color(const Color_t color) {
     g_renderer->bg_color = color;
     g_renderer->bg_type = BACKGROUND_NONE;
+    g_renderer->frame_complete = false;
+    destroy_bg_textures();
 }
 
 void render_set_bg_gradient(const Color_t top_color, const Color_t bottom_color, const BackgroundType_t type) {
     g_renderer->bg_color = top_color;
     g_renderer->bg_color_secondary = bottom_color;
     g_renderer->bg_type = type;
+    g_renderer->frame_complete = false;
+    destroy_bg_textures();
+}
+
+void render_set_bg_quality(const int32_t resolution_divisor, const int32_t update_interval) {
+    g_renderer->bg_resolution_divisor = MAX(1, resolution_divisor);
+    g_renderer->bg_update_interval = MAX(1, update_interval);
+    destroy_bg_textures();
 }
 
 static float calculate_color_luminance(const Color_t *color) {
@@ -1029,6 +2440,8 @@ void render_sample_bg_colors_from_image(const unsigned char *bytes, const int le
     }
     // Mark as initialized
     g_renderer->dynamic_bg_colors_initialized = true;
+    g_renderer->frame_complete = false;
+    destroy_bg_textures();
 
     // Cleanup
     free(assignments);
@@ -1039,23 +2452,21 @@ void render_sample_bg_colors_from_image(const unsigned char *bytes, const int le
 void render_set_blend_mode(const BlendMode_t mode) {
     if ( mode == g_renderer->blend_mode )
         return;
+    flush_sprite_batch();
     g_renderer->blend_mode = mode;
 
     switch ( mode ) {
     case BLEND_MODE_BLEND:
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        gl_set_blend(true, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
         break;
     case BLEND_MODE_ADD:
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_ONE, GL_ONE);
+        gl_set_blend(true, GL_ONE, GL_ONE);
         break;
     case BLEND_MODE_NONE:
-        glDisable(GL_BLEND);
+        gl_set_blend(false, GL_ONE, GL_ZERO);
         break;
     case BLEND_MODE_ERASE:
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+        gl_set_blend(true, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
         break;
     default:
         error_abort("Invalid blend mode");
@@ -1064,157 +2475,579 @@ void render_set_blend_mode(const BlendMode_t mode) {
 
 BlendMode_t render_get_blend_mode(void) { return g_renderer->blend_mode; }
 
-Texture_t *render_make_null(void) {
-    Texture_t *texture = calloc(1, sizeof(*texture));
-    texture->width = 0;
-    texture->height = 0;
-    texture->id = 0;
-    // Init VBO
+bool render_set_gpu_timing(const bool enabled) {
+#ifdef __EMSCRIPTEN__
+    // WebGL 2 has no timer queries without an extension
+    (void)enabled;
+    return false;
+#else
+    GpuTimer_t *timer = &g_renderer->gpu_timer;
+    if ( enabled == timer->enabled ) {
+        return enabled;
+    }
 
-    glGenVertexArrays(1, &texture->vao);
-    glGenBuffers(1, &texture->vbo);
+    if ( !enabled ) {
+        gpu_timer_stop();
+    }
+    for ( int32_t i = 0; i < 2; i++ ) {
+        GpuTimerFrame_t *frame = &timer->frames[i];
+        if ( enabled ) {
+            glGenQueries(GPU_TIMER_MAX_QUERIES, frame->queries);
+        } else {
+            glDeleteQueries(GPU_TIMER_MAX_QUERIES, frame->queries);
+        }
+        frame->count = 0;
+    }
+    timer->current = 0;
+    timer->history_next = timer->history_count = 0;
+    timer->enabled = enabled;
+    return enabled;
+#endif
+}
 
-    glBindVertexArray(texture->vao);
-    glBindBuffer(GL_ARRAY_BUFFER, texture->vbo);
+int32_t render_get_gpu_timings(RenderPassTiming_t out[RENDER_PASS_COUNT]) {
+    const GpuTimer_t *timer = &g_renderer->gpu_timer;
+    const int32_t last = (timer->history_next + GPU_TIMER_HISTORY - 1) % GPU_TIMER_HISTORY;
 
-    // Allocate buffer (4 vertices * 4 floats per vertex: x, y, u, v)
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 4 * 4, NULL, GL_DYNAMIC_DRAW);
+    for ( int32_t pass = 0; pass < RENDER_PASS_COUNT; pass++ ) {
+        uint64_t total = 0, max = 0;
+        for ( int32_t i = 0; i < timer->history_count; i++ ) {
+            total += timer->history[i][pass];
+            max = MAX(max, timer->history[i][pass]);
+        }
 
-    // Position attribute (location 0)
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), NULL);
+        RenderPassTiming_t *timing = &out[pass];
+        timing->name = GPU_PASS_NAMES[pass];
+        timing->max_ms = (double)max / 1e6;
+        if ( timer->history_count > 0 ) {
+            timing->last_ms = (double)timer->history[last][pass] / 1e6;
+            timing->average_ms = (double)total / 1e6 / timer->history_count;
+        } else {
+            timing->last_ms = timing->average_ms = 0;
+        }
+    }
 
-    // TexCoord attribute (location 1)
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *)(2 * sizeof(float)));
+    return timer->history_count;
+}
 
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+void render_print_gpu_timings(void) {
+    RenderPassTiming_t timings[RENDER_PASS_COUNT];
+    const int32_t num_frames = render_get_gpu_timings(timings);
+    if ( num_frames == 0 ) {
+        printf("No GPU timings were measured\n");
+        return;
+    }
 
-    return texture;
+    printf("GPU time per pass over the last %d frames (ms):\n", num_frames);
+    printf("  %-12s %8s %8s %8s\n", "pass", "last", "average", "max");
+    double total_last = 0, total_average = 0;
+    for ( int32_t pass = 0; pass < RENDER_PASS_COUNT; pass++ ) {
+        const RenderPassTiming_t *timing = &timings[pass];
+        printf("  %-12s %8.3f %8.3f %8.3f\n", timing->name, timing->last_ms, timing->average_ms, timing->max_ms);
+        total_last += timing->last_ms;
+        total_average += timing->average_ms;
+    }
+    printf("  %-12s %8.3f %8.3f\n", "total", total_last, total_average);
 }
 
-Texture_t *render_make_text(const char *text, const int32_t pixels_size, const Color_t *color, const FontType_t font_type) {
-    const stbtt_fontinfo *font = font_type == FONT_UI ? &g_renderer->ui_font_info : &g_renderer->lyrics_font_info;
+bool render_begin_capture(const int32_t width, const int32_t height, const RenderCaptureFunc_t func, void *user_data) {
+#ifdef __EMSCRIPTEN__
+    // WebGL 2 can't map buffers to read them
+    (void)width;
+    (void)height;
+    (void)func;
+    (void)user_data;
+    return false;
+#else
+    FrameCapture_t *capture = &g_renderer->capture;
+    if ( capture->func != NULL ) {
+        render_end_capture();
+    }
+    if ( width <= 0 || height <= 0 || func == NULL ) {
+        return false;
+    }
 
-    if ( strlen(text) == 0 ) {
-        error_abort("render_make_text: Text is empty");
+    flush_sprite_batch();
+    capture->func = func;
+    capture->user_data = user_data;
+    capture->width = width;
+    capture->height = height;
+    capture->next = 0;
+    glGenBuffers(2, capture->buffers);
+    for ( int32_t i = 0; i < 2; i++ ) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->buffers[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * 4, NULL, GL_STREAM_READ);
+        capture->pending[i] = false;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    render_on_window_changed();
+    return true;
+#endif
+}
+
+void render_end_capture(void) {
+#ifndef __EMSCRIPTEN__
+    FrameCapture_t *capture = &g_renderer->capture;
+    if ( capture->func == NULL ) {
+        return;
     }
 
-    // TODO: Improve performance (single pass bitmap creation, reusing bitmap buffers)
-    // TODO: Maybe look into SDF and making a texture atlas
+    // Whichever was read last is still waiting to be handed out
+    capture_deliver(1 - capture->next);
+    glDeleteBuffers(2, capture->buffers);
+    capture->func = NULL;
+    capture->user_data = NULL;
+    capture->width = capture->height = 0;
+#endif
+}
 
-    const float pixel_height = (float)pixels_size;
-    const float scale = stbtt_ScaleForMappingEmToPixels(font, pixel_height);
+uint64_t render_get_elided_state_changes(void) { return g_renderer->gl_state.elided_changes; }
+
+Texture_t *render_make_null(void) {
+    Texture_t *texture = calloc(1, sizeof(*texture));
+    texture->serial = ++g_renderer->next_texture_serial;
+    texture->width = 0;
+    texture->height = 0;
+    texture->id = 0;
+    return texture;
+}
 
-    int ascent, descent, lineGap;
-    stbtt_GetFontVMetrics(font, &ascent, &descent, &lineGap);
+/**
+ * Copies the coverage of every glyph of the text from the atlas into the bitmap
+ */
+static void compose_coverage_text(TextBitmap_t *bitmap, const char *text, const int32_t len, const int32_t pixels_size,
+                                  const FontType_t font_type, const float scale, const int baseline) {
+    const int width = bitmap->width, height = bitmap->height;
 
-    const int baseline = (int)(ascent * (double)scale);
-    const int height = (int)((ascent - descent + lineGap) * (double)scale);
+    const stbtt_fontinfo *font = get_font_info(font_type);
+    FontMetrics_t *metrics = get_font_metrics(font_type);
 
-    int width = 0;
+    double x = 0;
     int32_t i = 0;
-    const int32_t len = (int32_t)strlen(text);
     int32_t c = 0;
-    int32_t prev_c = -1;
+    int prev_glyph = -1;
 
     while ( i < len ) {
-        // U8_NEXT(text, i, len, c);
         c = str_u8_next(text, len, &i);
         if ( c < 0 )
             continue;
 
-        int advance, lsb;
-        stbtt_GetCodepointHMetrics(font, c, &advance, &lsb);
+        const GlyphMetrics_t char_metrics = font_get_glyph_metrics(metrics, font, c);
 
-        if ( prev_c != -1 ) {
-            width += stbtt_GetCodepointKernAdvance(font, prev_c, c);
+        if ( prev_glyph != -1 ) {
+            x += font_get_kerning(metrics, font, prev_glyph, char_metrics.glyph_index) * (double)scale;
         }
 
-        width += advance;
-        prev_c = c;
+        // Glyphs are always rasterized without any subpixel shift, so the cached bitmap is the same for every position
+        const AtlasGlyph_t *glyph = glyph_atlas_get(font_type, c, pixels_size, false);
+        const GlyphAtlas_t *atlas = &g_renderer->glyph_atlas;
+
+        const int target_x = (int)x + glyph->x_off;
+        const int target_y = baseline + glyph->y_off;
+
+        for ( int y = 0; y < glyph->h; ++y ) {
+            const int out_y = target_y + y;
+            if ( out_y < 0 || out_y >= height )
+                continue;
+
+            const unsigned char *src_row = atlas->pixels + (size_t)(glyph->y + y) * atlas->width + glyph->x;
+            for ( int x_pix = 0; x_pix < glyph->w; ++x_pix ) {
+                const int out_x = target_x + x_pix;
+                if ( out_x >= 0 && out_x < width ) {
+                    const unsigned char val = src_row[x_pix];
+                    if ( val > 0 ) {
+                        bitmap->pixels[out_y * width + out_x] = val;
+                    }
+                }
+            }
+        }
+
+        x += char_metrics.advance * (double)scale;
+        prev_glyph = char_metrics.glyph_index;
+    }
+}
+
+/**
+ * Bilinearly samples a distance field glyph from the atlas, treating everything outside of it as being fully outside
+ */
+static float sample_sdf_glyph(const GlyphAtlas_t *atlas, const AtlasGlyph_t *glyph, const float u, const float v) {
+    const int32_t x0 = (int32_t)floorf(u), y0 = (int32_t)floorf(v);
+    const float fx = u - (float)x0, fy = v - (float)y0;
+
+    float texels[2][2];
+    for ( int32_t dy = 0; dy < 2; dy++ ) {
+        for ( int32_t dx = 0; dx < 2; dx++ ) {
+            const int32_t sx = x0 + dx, sy = y0 + dy;
+            if ( sx < 0 || sy < 0 || sx >= glyph->w || sy >= glyph->h ) {
+                texels[dy][dx] = 0.f;
+            } else {
+                texels[dy][dx] = atlas->pixels[(size_t)(glyph->y + sy) * atlas->width + glyph->x + sx];
+            }
+        }
     }
-    width = (int)(width * (double)scale);
 
-    unsigned char *bitmap = calloc(1, width * height);
+    const float top = texels[0][0] + (texels[0][1] - texels[0][0]) * fx;
+    const float bottom = texels[1][0] + (texels[1][1] - texels[1][0]) * fx;
+    return top + (bottom - top) * fy;
+}
+
+/**
+ * Resamples the reference size distance field of every glyph of the text from the atlas into the bitmap
+ */
+static void compose_sdf_text(TextBitmap_t *bitmap, const char *text, const int32_t len, const int32_t pixels_size,
+                             const FontType_t font_type, const float scale, const int baseline) {
+    const int width = bitmap->width, height = bitmap->height;
+    // Glyphs come from the atlas at the reference size, so they have to be resampled by this factor
+    const float glyph_scale = (float)pixels_size / SDF_REFERENCE_PIXELS;
+
+    const stbtt_fontinfo *font = get_font_info(font_type);
+    FontMetrics_t *metrics = get_font_metrics(font_type);
 
     double x = 0;
-    i = 0;
-    prev_c = -1;
+    int32_t i = 0;
+    int32_t c = 0;
+    int prev_glyph = -1;
 
     while ( i < len ) {
         c = str_u8_next(text, len, &i);
         if ( c < 0 )
             continue;
 
-        int advance, lsb;
-        stbtt_GetCodepointHMetrics(font, c, &advance, &lsb);
+        const GlyphMetrics_t char_metrics = font_get_glyph_metrics(metrics, font, c);
 
-        if ( prev_c != -1 ) {
-            x += stbtt_GetCodepointKernAdvance(font, prev_c, c) * (double)scale;
+        if ( prev_glyph != -1 ) {
+            x += font_get_kerning(metrics, font, prev_glyph, char_metrics.glyph_index) * (double)scale;
         }
 
-        int x0, y0, x1, y1;
-        stbtt_GetCodepointBitmapBoxSubpixel(font, c, scale, scale, 0, 0, &x0, &y0, &x1, &y1);
+        const AtlasGlyph_t *glyph = glyph_atlas_get(font_type, c, SDF_REFERENCE_PIXELS, true);
+        const GlyphAtlas_t *atlas = &g_renderer->glyph_atlas;
+
+        if ( glyph->w > 0 && glyph->h > 0 ) {
+            const float origin_x = (float)x + (float)glyph->x_off * glyph_scale;
+            const float origin_y = (float)baseline + (float)glyph->y_off * glyph_scale;
+            const int32_t start_x = MAX(0, (int32_t)floorf(origin_x));
+            const int32_t start_y = MAX(0, (int32_t)floorf(origin_y));
+            const int32_t end_x = MIN(width, (int32_t)ceilf(origin_x + (float)glyph->w * glyph_scale));
+            const int32_t end_y = MIN(height, (int32_t)ceilf(origin_y + (float)glyph->h * glyph_scale));
+
+            for ( int32_t out_y = start_y; out_y < end_y; out_y++ ) {
+                const float v = ((float)out_y + 0.5f - origin_y) / glyph_scale - 0.5f;
+                for ( int32_t out_x = start_x; out_x < end_x; out_x++ ) {
+                    const float u = ((float)out_x + 0.5f - origin_x) / glyph_scale - 0.5f;
+                    const unsigned char val = (unsigned char)lroundf(sample_sdf_glyph(atlas, glyph, u, v));
+                    // Padding of neighbouring glyphs overlaps, so keep whichever is closest to being inside a glyph
+                    if ( val > bitmap->pixels[out_y * width + out_x] ) {
+                        bitmap->pixels[out_y * width + out_x] = val;
+                    }
+                }
+            }
+        }
 
-        int c_w, c_h, c_xoff, c_yoff;
-        unsigned char *char_bitmap = stbtt_GetCodepointBitmapSubpixel(font, 0, scale, 0, 0, c, &c_w, &c_h, &c_xoff, &c_yoff);
+        x += char_metrics.advance * (double)scale;
+        prev_glyph = char_metrics.glyph_index;
+    }
+}
 
-        if ( char_bitmap ) {
-            const int target_x = (int)x + c_xoff;
-            const int target_y = baseline + c_yoff;
+TextBitmap_t *render_make_empty_text_bitmap(const int32_t width, const int32_t height, const bool sdf) {
+    TextBitmap_t *bitmap = calloc(1, sizeof(*bitmap));
+    if ( bitmap == NULL ) {
+        error_abort("Failed to allocate text bitmap");
+    }
+    bitmap->width = width;
+    bitmap->height = height;
+    bitmap->sdf = sdf;
+    bitmap->pixels = calloc(1, (size_t)MAX(1, width * height));
+    if ( bitmap->pixels == NULL ) {
+        error_abort("Failed to allocate text bitmap pixels");
+    }
+    return bitmap;
+}
 
-            for ( int y = 0; y < c_h; ++y ) {
-                for ( int x_pix = 0; x_pix < c_w; ++x_pix ) {
-                    const int out_x = target_x + x_pix;
-                    const int out_y = target_y + y;
+TextBitmap_t *render_make_text_bitmap(const char *text, const int32_t pixels_size, const FontType_t font_type, const bool sdf) {
+    const FontMetrics_t *metrics = get_font_metrics(font_type);
 
-                    if ( out_x >= 0 && out_x < width && out_y >= 0 && out_y < height ) {
-                        const unsigned char val = char_bitmap[y * c_w + x_pix];
-                        if ( val > 0 ) {
-                            bitmap[out_y * width + out_x] = val;
-                        }
-                    }
-                }
+    if ( strlen(text) == 0 ) {
+        error_abort("render_make_text_bitmap: Text is empty");
+    }
+
+    const float scale = font_get_scale(metrics, pixels_size);
+
+    const int baseline = (int)(metrics->ascent * (double)scale);
+    const int height = (int)((metrics->ascent - metrics->descent + metrics->line_gap) * (double)scale);
+
+    const int32_t len = (int32_t)strlen(text);
+    const int width = measure_text_line_width(font_type, text, len, scale);
+
+    TextBitmap_t *bitmap = render_make_empty_text_bitmap(width, height, sdf);
+    if ( sdf ) {
+        compose_sdf_text(bitmap, text, len, pixels_size, font_type, scale, baseline);
+    } else {
+        compose_coverage_text(bitmap, text, len, pixels_size, font_type, scale, baseline);
+    }
+
+    return bitmap;
+}
+
+void render_blit_text_bitmap(TextBitmap_t *dest, const TextBitmap_t *src, const int32_t x, const int32_t y) {
+    const int32_t start_x = MAX(0, x), end_x = MIN(dest->width, x + src->width);
+    if ( end_x <= start_x )
+        return;
+
+    for ( int32_t src_y = 0; src_y < src->height; src_y++ ) {
+        const int32_t dest_y = y + src_y;
+        if ( dest_y < 0 || dest_y >= dest->height )
+            continue;
+
+        memcpy(dest->pixels + (size_t)dest_y * dest->width + start_x, src->pixels + (size_t)src_y * src->width + (start_x - x),
+               end_x - start_x);
+    }
+}
+
+void render_destroy_text_bitmap(TextBitmap_t *bitmap) {
+    if ( bitmap == NULL )
+        return;
+    free(bitmap->pixels);
+    free(bitmap);
+}
+
+Texture_t *render_make_text_texture(const TextBitmap_t *bitmap, const Color_t *color) {
+    // Any glyphs rasterized while making the bitmap are uploaded along with it
+    glyph_atlas_flush();
+
+    Texture_t *texture = render_make_null();
+    texture->width = bitmap->width;
+    texture->height = bitmap->height;
+    texture->single_channel = true;
+    texture->color = *color;
+    texture->sdf = bitmap->sdf;
+
+    const GLuint texture_id = texture_pool_acquire(bitmap->width, bitmap->height, GL_R8);
+    gl_bind_texture(texture_id);
+
+    // Rows of a single channel bitmap are tightly packed
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, bitmap->width, bitmap->height, GL_RED, GL_UNSIGNED_BYTE, bitmap->pixels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    texture->id = texture_id;
+
+    return texture;
+}
+
+Texture_t *render_make_text(const char *text, const int32_t pixels_size, const Color_t *color, const FontType_t font_type) {
+    TRACE_BEGIN("render_make_text");
+    TextBitmap_t *bitmap = render_make_text_bitmap(text, pixels_size, font_type, false);
+    Texture_t *texture = render_make_text_texture(bitmap, color);
+    render_destroy_text_bitmap(bitmap);
+    TRACE_END();
+    return texture;
+}
+
+Texture_t *render_make_sdf_text(const char *text, const int32_t pixels_size, const Color_t *color, const FontType_t font_type) {
+    TextBitmap_t *bitmap = render_make_text_bitmap(text, pixels_size, font_type, true);
+    Texture_t *texture = render_make_text_texture(bitmap, color);
+    render_destroy_text_bitmap(bitmap);
+    return texture;
+}
+
+GlyphRun_t *render_make_glyph_run(const FontType_t font_type, const int32_t pixels_size, const bool sdf) {
+    GlyphRun_t *run = calloc(1, sizeof(*run));
+    if ( run == NULL ) {
+        error_abort("Failed to allocate glyph run");
+    }
+    run->font_type = font_type;
+    run->pixels_size = pixels_size;
+    run->sdf = sdf;
+    return run;
+}
+
+void render_glyph_run_add_text(GlyphRun_t *run, const char *text, const double x, const double y) {
+    const stbtt_fontinfo *font = get_font_info(run->font_type);
+    FontMetrics_t *metrics = get_font_metrics(run->font_type);
+    const float scale = font_get_scale(metrics, run->pixels_size);
+    // Lines are placed exactly like a bitmap made by render_make_text_bitmap and blitted at the same position would be
+    const int baseline = (int)(metrics->ascent * (double)scale);
+    const int32_t len = (int32_t)strlen(text);
+
+    double pen_x = 0;
+    int32_t i = 0;
+    int prev_glyph = -1;
+
+    while ( i < len ) {
+        const int32_t c = str_u8_next(text, len, &i);
+        if ( c < 0 )
+            continue;
+
+        const GlyphMetrics_t char_metrics = font_get_glyph_metrics(metrics, font, c);
+
+        if ( prev_glyph != -1 ) {
+            pen_x += font_get_kerning(metrics, font, prev_glyph, char_metrics.glyph_index) * (double)scale;
+        }
+
+        if ( run->count == run->capacity ) {
+            const size_t new_capacity = run->capacity == 0 ? 64 : run->capacity * 2;
+            RunGlyph_t *new_glyphs = realloc(run->glyphs, new_capacity * sizeof(*new_glyphs));
+            if ( new_glyphs == NULL ) {
+                error_abort("Failed to grow glyph run");
             }
-            stbtt_FreeBitmap(char_bitmap, NULL);
+            run->glyphs = new_glyphs;
+            run->capacity = new_capacity;
         }
 
-        x += advance * (double)scale;
-        prev_c = c;
+        RunGlyph_t *glyph = &run->glyphs[run->count++];
+        glyph->codepoint = c;
+        // Coverage glyphs are snapped to whole pixels (as when composing a bitmap) so they map 1:1 to the texels of the atlas
+        glyph->pen_x = (float)((int32_t)x + (run->sdf ? pen_x : (int)pen_x));
+        glyph->baseline_y = (float)((int32_t)y + baseline);
+
+        pen_x += char_metrics.advance * (double)scale;
+        prev_glyph = char_metrics.glyph_index;
     }
+}
 
-    unsigned char *rgba = malloc(width * height * 4);
-    for ( int j = 0; j < width * height; ++j ) {
-        rgba[j * 4 + 0] = color->r;
-        rgba[j * 4 + 1] = color->g;
-        rgba[j * 4 + 2] = color->b;
-        rgba[j * 4 + 3] = bitmap[j];
+/**
+ * Builds a quad for every visible glyph of the run. Positions are in pixels relative to the run and texture coordinates are
+ * in atlas texels, normalized by the shader so the atlas can keep growing without invalidating them
+ */
+static void glyph_run_build_quads(GlyphRun_t *run) {
+    const GlyphAtlas_t *atlas = &g_renderer->glyph_atlas;
+    const int32_t atlas_pixels = run->sdf ? SDF_REFERENCE_PIXELS : run->pixels_size;
+    const float glyph_scale = (float)run->pixels_size / (float)atlas_pixels;
+
+    if ( run->quads == NULL ) {
+        run->quads = malloc(MAX(1, run->count) * sizeof(*run->quads));
+        if ( run->quads == NULL ) {
+            error_abort("Failed to allocate glyph run quads");
+        }
     }
-    free(bitmap);
 
+    for ( int32_t attempt = 0;; attempt++ ) {
+        const uint32_t generation = atlas->generation;
+        int32_t num_quads = 0;
+
+        for ( size_t i = 0; i < run->count; i++ ) {
+            const RunGlyph_t *run_glyph = &run->glyphs[i];
+            const AtlasGlyph_t *glyph = glyph_atlas_get(run->font_type, run_glyph->codepoint, atlas_pixels, run->sdf);
+            if ( glyph->w <= 0 || glyph->h <= 0 )
+                continue;
+
+            GlyphQuad_t *quad = &run->quads[num_quads++];
+            quad->x0 = run_glyph->pen_x + (float)glyph->x_off * glyph_scale;
+            quad->y0 = run_glyph->baseline_y + (float)glyph->y_off * glyph_scale;
+            quad->x1 = quad->x0 + (float)glyph->w * glyph_scale;
+            quad->y1 = quad->y0 + (float)glyph->h * glyph_scale;
+            quad->u0 = (float)glyph->x;
+            quad->v0 = (float)glyph->y;
+            quad->u1 = (float)(glyph->x + glyph->w);
+            quad->v1 = (float)(glyph->y + glyph->h);
+        }
+
+        if ( atlas->generation == generation ) {
+            run->num_quads = num_quads;
+            run->atlas_generation = generation;
+            break;
+        }
+        // The atlas was reset halfway through, so the glyphs placed before that are gone. Starting over from an empty atlas
+        // should always fit a single run
+        if ( attempt > 0 ) {
+            error_abort("Glyph run does not fit in the glyph atlas");
+        }
+    }
+}
+
+Texture_t *render_make_glyph_run_texture(GlyphRun_t *run, const int32_t width, const int32_t height, const Color_t *color) {
     Texture_t *texture = render_make_null();
     texture->width = width;
     texture->height = height;
+    texture->single_channel = true;
+    texture->color = *color;
+    texture->sdf = run->sdf;
+    texture->glyph_run = run;
 
-    GLuint texture_id;
-    glGenTextures(1, &texture_id);
-    glBindTexture(GL_TEXTURE_2D, texture_id);
+    // Rasterize everything now rather than on the first draw, same as any other text
+    glyph_run_build_quads(run);
+    glyph_atlas_flush();
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+    return texture;
+}
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+/**
+ * A glyph missing from the atlas, rasterized by one of the job workers before being copied into the atlas on the main thread
+ */
+typedef struct GlyphRasterJob_t {
+    FontType_t font_type;
+    int32_t codepoint;
+    int32_t pixels;
+    bool sdf;
+    AtlasGlyph_t glyph;
+    unsigned char *bitmap;
+} GlyphRasterJob_t;
+
+static void rasterize_glyph_job(void *user_data, const int32_t index) {
+    GlyphRasterJob_t *job = &((GlyphRasterJob_t *)user_data)[index];
+    job->bitmap = rasterize_glyph(job->font_type, job->codepoint, job->pixels, job->sdf, &job->glyph);
+}
+
+static int compare_codepoints(const void *a, const void *b) {
+    const int32_t left = *(const int32_t *)a, right = *(const int32_t *)b;
+    return (left > right) - (left < right);
+}
 
-    glBindTexture(GL_TEXTURE_2D, 0);
+void render_prepare_text_glyphs(const char *const *texts, const size_t num_texts, const int32_t pixels_size,
+                                const FontType_t font_type, const bool sdf) {
+    // Distance field glyphs are always rasterized at the reference size, see render_make_sdf_text
+    const int32_t atlas_pixels = sdf ? SDF_REFERENCE_PIXELS : pixels_size;
 
-    free(rgba);
-    texture->id = texture_id;
+    size_t num_codepoints = 0, codepoints_capacity = 256;
+    int32_t *codepoints = malloc(codepoints_capacity * sizeof(*codepoints));
+    if ( codepoints == NULL ) {
+        error_abort("Failed to allocate codepoints for glyph preparation");
+    }
 
-    return texture;
+    for ( size_t t = 0; t < num_texts; t++ ) {
+        const char *text = texts[t];
+        const int32_t len = (int32_t)strlen(text);
+        int32_t i = 0;
+        while ( i < len ) {
+            const int32_t c = str_u8_next(text, len, &i);
+            if ( c < 0 || glyph_atlas_lookup(font_type, c, atlas_pixels, sdf) != NULL )
+                continue;
+
+            if ( num_codepoints == codepoints_capacity ) {
+                codepoints_capacity *= 2;
+                int32_t *new_codepoints = realloc(codepoints, codepoints_capacity * sizeof(*codepoints));
+                if ( new_codepoints == NULL ) {
+                    error_abort("Failed to grow codepoints for glyph preparation");
+                }
+                codepoints = new_codepoints;
+            }
+            codepoints[num_codepoints++] = c;
+        }
+    }
+
+    // Every glyph missing from the atlas becomes a job, just once
+    qsort(codepoints, num_codepoints, sizeof(*codepoints), compare_codepoints);
+    GlyphRasterJob_t *jobs = calloc(MAX(1, num_codepoints), sizeof(*jobs));
+    if ( jobs == NULL ) {
+        error_abort("Failed to allocate glyph rasterization jobs");
+    }
+    int32_t num_jobs = 0;
+    for ( size_t i = 0; i < num_codepoints; i++ ) {
+        if ( i > 0 && codepoints[i] == codepoints[i - 1] )
+            continue;
+        jobs[num_jobs++] = (GlyphRasterJob_t){.font_type = font_type, .codepoint = codepoints[i], .pixels = atlas_pixels, .sdf = sdf};
+    }
+    free(codepoints);
+
+    jobs_parallel_for(num_jobs, rasterize_glyph_job, jobs);
+
+    // The atlas itself is only ever touched from the main thread
+    for ( int32_t i = 0; i < num_jobs; i++ ) {
+        glyph_atlas_insert(jobs[i].glyph, jobs[i].bitmap);
+        free_glyph_bitmap(jobs[i].bitmap, sdf);
+    }
+    free(jobs);
 }
 
 static Texture_t *create_test_texture(void) {
@@ -1239,16 +3072,9 @@ static Texture_t *create_test_texture(void) {
     texture->width = size;
     texture->height = size;
 
-    GLuint texture_id;
-    glGenTextures(1, &texture_id);
-    glBindTexture(GL_TEXTURE_2D, texture_id);
-
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    glBindTexture(GL_TEXTURE_2D, 0);
+    const GLuint texture_id = texture_pool_acquire(size, size, GL_RGBA);
+    gl_bind_texture(texture_id);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size, size, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
 
     free(pixels);
     texture->id = texture_id;
@@ -1263,15 +3089,9 @@ Texture_t *render_make_image(const unsigned char *bytes, const int length, const
         error_abort("Failed to load image");
     }
 
-    GLuint texture_id;
-    glGenTextures(1, &texture_id);
-    glBindTexture(GL_TEXTURE_2D, texture_id);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    const GLuint texture_id = texture_pool_acquire(w, h, GL_RGBA);
+    gl_bind_texture(texture_id);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
 
     free(pixels);
 
@@ -1297,12 +3117,12 @@ Texture_t *render_make_dummy_image(const double border_radius_em) {
     return texture;
 }
 
-void render_draw_rounded_rect(const Texture_t *null_tex, const Bounds_t *bounds, const Color_t *color,
-                              const float border_radius) {
+void render_draw_rounded_rect(const Bounds_t *bounds, const Color_t *color, const float border_radius) {
     if ( bounds->w <= 0 ) {
         return;
     }
 
+    gpu_timer_switch(RENDER_PASS_RECTS);
     set_shader_program(g_renderer->rect_shader);
 
     float r, g, b, a;
@@ -1313,37 +3133,99 @@ void render_draw_rounded_rect(const Texture_t *null_tex, const Bounds_t *bounds,
     glUniform1f(g_renderer->rect_radius_loc, border_radius);
     glUniformMatrix4fv(g_renderer->rect_projection_loc, 1, GL_FALSE, get_projection_matrix());
 
-    glBindVertexArray(null_tex->vao);
-    glBindBuffer(GL_ARRAY_BUFFER, null_tex->vbo);
-
-    if ( texture_needs_reconfigure(null_tex, bounds) ) {
-        const float padding = border_radius;
-        const float vertices[] = {(float)bounds->x - padding,
-                                  (float)bounds->y - padding,
-                                  0.0f,
-                                  0.0f,
-                                  (float)(bounds->x + bounds->w) + padding,
-                                  (float)bounds->y - padding,
-                                  1.0f,
-                                  0.0f,
-                                  (float)(bounds->x + bounds->w) + padding,
-                                  (float)(bounds->y + bounds->h) + padding,
-                                  1.0f,
-                                  1.0f,
-                                  (float)bounds->x - padding,
-                                  (float)(bounds->y + bounds->h) + padding,
-                                  0.0f,
-                                  1.0f};
-        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-    }
-
-    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    // Padded by the radius so the antialiased edge isn't cut off
+    const float padding = border_radius;
+    glUniform4f(g_renderer->rect_quad_loc, (float)bounds->x - padding, (float)bounds->y - padding,
+                (float)bounds->w + padding * 2.f, (float)bounds->h + padding * 2.f);
+
+    draw_unit_quad();
+}
+
+/**
+ * Queues a quad covering the given rectangle of the whole texture (from 0 to 1) and sampling the given texels of it, placed as
+ * if the whole texture was drawn at x, y with a size of w by h. When clip is set, only the part of the quad inside of it is
+ * queued
+ */
+static void queue_sprite_quad(const SpriteInstance_t *sprite, const float region[4], const float uv[4], const float x,
+                              const float y, const float w, const float h, const float *clip) {
+    float r[4] = {region[0], region[1], region[2], region[3]};
+    float t[4] = {uv[0], uv[1], uv[2], uv[3]};
+    if ( clip != NULL ) {
+        r[0] = MAX(r[0], clip[0]);
+        r[1] = MAX(r[1], clip[1]);
+        r[2] = MIN(r[2], clip[2]);
+        r[3] = MIN(r[3], clip[3]);
+        if ( r[0] >= r[2] || r[1] >= r[3] ) {
+            return;
+        }
+        // Sample only the matching part of the texels
+        for ( int i = 0; i < 4; i++ ) {
+            const int axis = i % 2;
+            const float progress = (r[i] - region[axis]) / (region[axis + 2] - region[axis]);
+            t[i] = uv[axis] + progress * (uv[axis + 2] - uv[axis]);
+        }
+    }
+
+    const float x0 = x + r[0] * w, y0 = y + r[1] * h;
+    SpriteInstance_t *instance = sprite_batch_push();
+    *instance = *sprite;
+    instance->quad[0] = x0;
+    instance->quad[1] = y0;
+    instance->quad[2] = x + r[2] * w - x0;
+    instance->quad[3] = y + r[3] * h - y0;
+    memcpy(instance->uv, t, sizeof(t));
+    memcpy(instance->region, r, sizeof(r));
+}
+
+/**
+ * Queues every quad the texture is made of (the whole texture, or one per glyph of its glyph run) as sprites based on the
+ * given one, placed and clipped the same way queue_sprite_quad does
+ */
+static void queue_texture_quads(const Texture_t *texture, const SpriteInstance_t *sprite, const float x, const float y,
+                                const float w, const float h, const float *clip) {
+    if ( texture->glyph_run == NULL ) {
+        const float region[4] = {0.f, 0.f, 1.f, 1.f};
+        const float uv[4] = {0.f, 0.f, (float)texture->width, (float)texture->height};
+        queue_sprite_quad(sprite, region, uv, x, y, w, h, clip);
+        return;
+    }
+
+    const GlyphRun_t *run = texture->glyph_run;
+    const float local_w = (float)texture->width, local_h = (float)texture->height;
+    for ( int32_t i = 0; i < run->num_quads; i++ ) {
+        const GlyphQuad_t *glyph = &run->quads[i];
+        const float region[4] = {glyph->x0 / local_w, glyph->y0 / local_h, glyph->x1 / local_w, glyph->y1 / local_h};
+        const float uv[4] = {glyph->u0, glyph->v0, glyph->u1, glyph->v1};
+        queue_sprite_quad(sprite, region, uv, x, y, w, h, clip);
+    }
+}
+
+/**
+ * Draws a shadow blurred ahead of time (see render_make_blurred_shadow) for a texture drawn at the given place with a size of
+ * w by h
+ */
+static void draw_blurred_shadow(const Shadow_t *shadow, const Bounds_t *at, const float w, const float h, const float scale,
+                                const uint8_t alpha_mod) {
+    const Texture_t *texture = shadow->texture;
+    const float scale_x = w / (float)shadow->bounds.w, scale_y = h / (float)shadow->bounds.h;
+    const float quad_w = (float)texture->width * scale_x, quad_h = (float)texture->height * scale_y;
+    // The blurred coverage is centered on the texture, then moved by the offset
+    const float offset = (float)shadow->offset * scale;
+    const float x = (float)at->x - (quad_w - w) / 2.f + offset, y = (float)at->y - (quad_h - h) / 2.f + offset;
+
+    SpriteInstance_t sprite = {0};
+    sprite.color[3] = (float)alpha_mod / 255.0f;
+    sprite.params[0] = 1.f;
+    sprite.extra[2] = quad_w;
+    sprite.extra[3] = quad_h;
+
+    sprite_batch_prepare(texture->id, texture->width, texture->height);
+    sprite_set_regions(&sprite, NULL, 0, NULL, 0);
+    queue_texture_quads(texture, &sprite, x, y, quad_w, quad_h, NULL);
 }
 
 void render_draw_texture(Texture_t *texture, const Bounds_t *at, const DrawTextureOpts_t *opts) {
-    if ( texture == NULL || texture->id == 0 ) {
+    if ( texture == NULL || (texture->id == 0 && texture->glyph_run == NULL) ) {
         error_abort("Warning: Attempting to draw invalid texture\n");
     }
 
@@ -1355,12 +3237,21 @@ void render_draw_texture(Texture_t *texture, const Bounds_t *at, const DrawTextu
         return;
     }
 
-    const float *projection = get_projection_matrix();
-
-    set_shader_program(g_renderer->texture_shader);
+    const Shadow_t *shadow = opts->shadow;
+    if ( shadow != NULL ) {
+        gpu_timer_switch(RENDER_PASS_SHADOWS);
+        if ( shadow->texture != NULL ) {
+            draw_blurred_shadow(shadow, at, w, h, scale, opts->alpha_mod);
+            return;
+        }
+    } else if ( texture->glyph_run != NULL || texture->single_channel ) {
+        gpu_timer_switch(RENDER_PASS_TEXT);
+    } else {
+        gpu_timer_switch(RENDER_PASS_IMAGES);
+    }
 
     int num_draw_regions = 0;
-    if ( opts->draw_regions != NULL ) {
+    if ( opts->draw_regions != NULL && shadow == NULL ) {
         num_draw_regions = MIN(MAX_DRAW_SUB_REGIONS, opts->draw_regions->num_regions);
     }
 
@@ -1373,6 +3264,7 @@ void render_draw_texture(Texture_t *texture, const Bounds_t *at, const DrawTextu
         regions[i][3] = region->y1_perc;
     }
 
+    // Shadows are scaled along with the texture so that they keep lining up with it
     int num_erase_regions = 0;
     if ( opts->scale_regions != NULL ) {
         num_erase_regions = MIN(MAX_SCALE_SUB_REGIONS, opts->scale_regions->num_regions);
@@ -1388,117 +3280,172 @@ void render_draw_texture(Texture_t *texture, const Bounds_t *at, const DrawTextu
         erase_regions[i][3] = region->y1_perc;
     }
 
-    glUniform1f(g_renderer->tex_border_radius_loc, texture->border_radius);
-    glUniform1f(g_renderer->tex_alpha_loc, (float)opts->alpha_mod / 255.0f);
-    glUniform2f(g_renderer->tex_rect_size_loc, w, h);
-    glUniform1i(g_renderer->tex_use_bounds_loc, 1);
-    glUniform4f(g_renderer->tex_bounds_loc, (float)at->x, (float)at->y, w, h);
-    glUniformMatrix4fv(g_renderer->tex_projection_loc, 1, GL_FALSE, projection);
-    glUniform1f(g_renderer->tex_color_mod_loc, opts->color_mod);
-    glUniform1i(g_renderer->tex_num_regions_loc, num_draw_regions);
-    if ( num_draw_regions > 0 ) {
-        glUniform4fv(g_renderer->tex_regions_loc, MAX_DRAW_SUB_REGIONS, &regions[0][0]);
+    // Everything but the position of every quad is the same for the whole draw
+    SpriteInstance_t sprite = {0};
+    int32_t flags = 0;
+    if ( texture->sdf )
+        flags |= SPRITE_FLAG_SDF;
+    if ( texture->single_channel )
+        flags |= SPRITE_FLAG_SINGLE_CHANNEL;
+    if ( texture->glyph_run != NULL )
+        flags |= SPRITE_FLAG_GLYPH;
+
+    if ( texture->single_channel ) {
+        deconstruct_colors_opengl(&texture->color, &sprite.color[0], &sprite.color[1], &sprite.color[2], NULL);
     }
-    glUniform1i(g_renderer->tex_num_erase_regions_loc, num_erase_regions);
-    if ( num_erase_regions > 0 ) {
-        glUniform4fv(g_renderer->tex_erase_regions_loc, MAX_SCALE_SUB_REGIONS, &erase_regions[0][0]);
+    sprite.color[3] = (float)opts->alpha_mod / 255.0f;
+    sprite.params[0] = opts->color_mod;
+    sprite.params[1] = texture->border_radius;
+    sprite.extra[2] = w;
+    sprite.extra[3] = h;
+    if ( shadow != NULL ) {
+        // Glyph quads can't grow past their own glyph in the atlas, so their shadows are only softened as far as the distance
+        // field reaches, and the coverage ones can't tell their own glyph from their neighbours' to cut themselves out
+        const bool coverage_glyphs = texture->glyph_run != NULL && !texture->sdf;
+        float softness = shadow->softness * scale;
+        if ( coverage_glyphs ) {
+            // Keep the filter taps inside the padding around the glyph in the atlas
+            softness = MIN(softness, 2.f * GLYPH_ATLAS_PADDING * w / (float)texture->width);
+        }
+        flags |= SPRITE_FLAG_SHADOW;
+        if ( !coverage_glyphs )
+            flags |= SPRITE_FLAG_SHADOW_ERASE;
+        sprite.params[2] = softness;
+        sprite.extra[0] = (float)shadow->offset * scale;
+        sprite.extra[1] = texture->glyph_run != NULL ? 0.f : shadow->softness * scale;
     }
+    sprite.params[3] = (float)flags;
+
+    GLuint texture_id = texture->id;
+    int32_t texture_width = texture->width, texture_height = texture->height;
+    if ( texture->glyph_run != NULL ) {
+        // Glyph quads only change when the atlas was reset from under them
+        GlyphRun_t *run = texture->glyph_run;
+        if ( run->atlas_generation != g_renderer->glyph_atlas.generation ) {
+            glyph_run_build_quads(run);
+        }
+        glyph_atlas_flush();
 
-    glBindTexture(GL_TEXTURE_2D, texture->id);
-
-    glBindVertexArray(texture->vao);
-    glBindBuffer(GL_ARRAY_BUFFER, texture->vbo);
-
-    const Bounds_t final_bounds = {.x = at->x, .y = at->y, .w = (int32_t)w, .h = (int32_t)h};
-    if ( texture_needs_reconfigure(texture, &final_bounds) ) {
-        float vertices[QUAD_VERTICES_SIZE] = {0};
-        create_quad_vertices((float)at->x, (float)at->y, w, h, vertices);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), &vertices, GL_STATIC_DRAW);
-        mark_texture_configured(texture, &final_bounds);
+        const GlyphAtlas_t *atlas = &g_renderer->glyph_atlas;
+        texture_id = atlas->texture;
+        texture_width = atlas->width;
+        texture_height = atlas->height;
     }
 
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    sprite_batch_prepare(texture_id, texture_width, texture_height);
+    sprite_set_regions(&sprite, regions, num_draw_regions, erase_regions, num_erase_regions);
+    queue_texture_quads(texture, &sprite, (float)at->x, (float)at->y, w, h, NULL);
 
-    // Re-draw the scaled portions of the texture in separate draw calls
-    // this will of course induce additional rebuilding of the VBO and the draw calls themselves but...
-    // well, right now it's a lot better than making a separate texture for every text segment
+    // Draw the scaled portions of the texture again where they were erased, each clipped to its own region and scaled
+    // around its center, all in the same batch as the rest of the texture
+    SpriteInstance_t scaled_sprite = sprite;
+    memset(scaled_sprite.region_range, 0, sizeof(scaled_sprite.region_range));
     for ( int i = 0; i < num_erase_regions; i++ ) {
         const ScaleRegionOpt_t *region = &opts->scale_regions->regions[i];
-        Bounds_t bounds = *at;
-        bounds.scale_mod += region->relative_scale;
+        const float region_scale = MAX(0.f, 1.f + (float)at->scale_mod + region->relative_scale);
+        const float scaled_w = (float)(at->w == 0 ? (float)texture->width : at->w) * region_scale;
+        const float scaled_h = (float)(at->w == 0 ? (float)texture->height : at->h) * region_scale;
         // Also compensate for the scale by centering the texture by the amount scaled
         // relative to the center of the region
         const float center_x = (region->x0_perc + region->x1_perc) / 2.f;
         const float center_y = (region->y0_perc + region->y1_perc) / 2.f;
-        bounds.x -= bounds.w * region->relative_scale * center_x;
-        bounds.y -= bounds.h * region->relative_scale * center_y;
-        // Options will be the same with the exception that the draw region(s) will be just one with the actual bound
-        // to be drawn, considering the actual draw regions set
-        DrawTextureOpts_t new_opts = *opts;
-        new_opts.scale_regions = NULL;
-        new_opts.draw_regions = NULL;
-
-        DrawRegionOptSet_t scaled_region = {0};
-        scaled_region.num_regions = 1;
-        DrawRegionOpt_t *scaled_region_opt = &scaled_region.regions[0];
-        scaled_region_opt->x0_perc = region->x0_perc;
-        scaled_region_opt->x1_perc = region->x1_perc;
-        scaled_region_opt->y0_perc = region->y0_perc;
-        scaled_region_opt->y1_perc = region->y1_perc;
-
-        // Now iterate through the set draw regions and set it accordingly
+        const float scaled_x = (float)(at->x - at->w * region->relative_scale * center_x);
+        const float scaled_y = (float)(at->y - at->h * region->relative_scale * center_y);
+
+        // Don't let the scaled portion show more than the draw regions covering it do
+        float clip[4] = {region->x0_perc, region->y0_perc, region->x1_perc, region->y1_perc};
         for ( int dr = 0; dr < num_draw_regions; dr++ ) {
             const DrawRegionOpt_t *draw_region = &opts->draw_regions->regions[dr];
-            if ( draw_region->y0_perc <= scaled_region_opt->y0_perc && draw_region->y1_perc >= scaled_region_opt->y1_perc ) {
-                scaled_region_opt->x1_perc = MIN(scaled_region_opt->x1_perc, draw_region->x1_perc);
+            if ( draw_region->y0_perc <= clip[1] && draw_region->y1_perc >= clip[3] ) {
+                clip[2] = MIN(clip[2], draw_region->x1_perc);
             }
         }
 
-        new_opts.draw_regions = &scaled_region;
-        render_draw_texture(texture, &bounds, &new_opts);
+        scaled_sprite.extra[2] = scaled_w;
+        scaled_sprite.extra[3] = scaled_h;
+        if ( shadow != NULL ) {
+            // Shadow quads grow past the clip to fit the softness, so the shader has to keep them inside of it instead
+            const float shadow_clip[1][4] = {{clip[0], clip[1], clip[2], clip[3]}};
+            sprite_set_regions(&scaled_sprite, shadow_clip, 1, NULL, 0);
+        }
+        queue_texture_quads(texture, &scaled_sprite, scaled_x, scaled_y, scaled_w, scaled_h, clip);
+    }
+}
+
+void render_measure_texture_area(const Texture_t *texture, const Bounds_t *at, const DrawTextureOpts_t *opts,
+                                 Bounds_t *out_area) {
+    const double base_w = at->w == 0 ? (double)texture->width : at->w;
+    const double base_h = at->w == 0 ? (double)texture->height : at->h;
+    const double scale = fmax(0.0, 1.0 + at->scale_mod);
+    double x0 = at->x, y0 = at->y, x1 = at->x + base_w * scale, y1 = at->y + base_h * scale;
+
+    if ( opts->scale_regions != NULL ) {
+        // Same placement as the scaled copies in render_draw_texture
+        for ( int i = 0; i < MIN(MAX_SCALE_SUB_REGIONS, opts->scale_regions->num_regions); i++ ) {
+            const ScaleRegionOpt_t *region = &opts->scale_regions->regions[i];
+            const double region_scale = fmax(0.0, 1.0 + at->scale_mod + region->relative_scale);
+            const double center_x = (region->x0_perc + region->x1_perc) / 2.0;
+            const double center_y = (region->y0_perc + region->y1_perc) / 2.0;
+            const double scaled_x = at->x - at->w * region->relative_scale * center_x;
+            const double scaled_y = at->y - at->h * region->relative_scale * center_y;
+            x0 = fmin(x0, scaled_x + region->x0_perc * base_w * region_scale);
+            y0 = fmin(y0, scaled_y + region->y0_perc * base_h * region_scale);
+            x1 = fmax(x1, scaled_x + region->x1_perc * base_w * region_scale);
+            y1 = fmax(y1, scaled_y + region->y1_perc * base_h * region_scale);
+        }
+    }
+
+    if ( opts->shadow != NULL ) {
+        // Moved by the offset and grown by the softness, on every side to keep it simple
+        const double grow = (fabs((double)opts->shadow->offset) + opts->shadow->softness) * scale;
+        x0 -= grow;
+        y0 -= grow;
+        x1 += grow;
+        y1 += grow;
     }
+
+    out_area->x = x0 - TEXTURE_AREA_MARGIN;
+    out_area->y = y0 - TEXTURE_AREA_MARGIN;
+    out_area->w = x1 - x0 + TEXTURE_AREA_MARGIN * 2.0;
+    out_area->h = y1 - y0 + TEXTURE_AREA_MARGIN * 2.0;
+    out_area->scale_mod = 0.0;
 }
 
 void render_destroy_shadow(Shadow_t *shadow) {
-    if ( shadow->texture ) {
+    if ( shadow->texture != NULL ) {
         render_destroy_texture(shadow->texture);
     }
     free(shadow);
 }
 
-Shadow_t *render_make_shadow(Texture_t *texture, const Bounds_t *src_bounds, const float blur_radius, const int32_t offset) {
-    const int32_t padding = offset / 2; // Leave some pixels for the blur
-    const int32_t width = (int32_t)src_bounds->w + offset + padding, height = (int32_t)src_bounds->h + offset + padding;
-
-    render_make_texture_target(width, height);
-    Bounds_t bounds = {.x = offset, .y = offset, .w = src_bounds->w, .h = src_bounds->h};
-    DrawTextureOpts_t opts = {.alpha_mod = 255, .color_mod = 0.f};
-    render_draw_texture(texture, &bounds, &opts);
-    // Erase the original texture
-    const BlendMode_t saved_blend = render_get_blend_mode();
-    render_set_blend_mode(BLEND_MODE_ERASE);
-
-    opts.color_mod = 1.f;
-    bounds.x = bounds.y = 0;
-    render_draw_texture(texture, &bounds, &opts);
-
-    render_set_blend_mode(saved_blend);
+Shadow_t *render_make_shadow(const float blur_radius, const int32_t offset) {
+    Shadow_t *shadow = calloc(1, sizeof(*shadow));
+    if ( shadow == NULL ) {
+        error_abort("Failed to allocate shadow");
+    }
 
-    Texture_t *result = render_restore_texture_target();
+    shadow->offset = offset;
+    shadow->softness = blur_radius;
+    return shadow;
+}
 
-    result->border_radius = texture->border_radius;
-    if ( blur_radius > 0.f ) {
-        result = render_blur_texture_replace(result, blur_radius);
+Shadow_t *render_make_blurred_shadow(Texture_t *texture, const Bounds_t *size, const float blur_radius, const int32_t offset) {
+    if ( size->w <= 0 || size->h <= 0 || blur_radius <= 0 ) {
+        error_abort("Invalid blurred shadow");
     }
+    Shadow_t *shadow = render_make_shadow(blur_radius, offset);
+    shadow->bounds = (Bounds_t){.w = size->w, .h = size->h};
 
-    Shadow_t *shadow = calloc(1, sizeof(*shadow));
-    shadow->offset = offset;
-    shadow->texture = result;
-    shadow->bounds = (Bounds_t){.w = width, .h = height};
+    // Leave room around the texture for the blur to spread into
+    const int32_t padding = (int32_t)ceilf(blur_radius);
+    render_make_texture_target((int32_t)size->w + padding * 2, (int32_t)size->h + padding * 2);
+    const BlendMode_t saved_blend = render_get_blend_mode();
+    // Keep its coverage exactly as it is, in black
+    render_set_blend_mode(BLEND_MODE_NONE);
+    const Bounds_t at = {.x = padding, .y = padding, .w = size->w, .h = size->h};
+    render_draw_texture(texture, &at, &(DrawTextureOpts_t){.alpha_mod = 255, .color_mod = 0.f});
+    render_set_blend_mode(saved_blend);
 
+    shadow->texture = render_blur_texture_replace(render_restore_texture_target(), blur_radius);
     return shadow;
 }
@@ -7,6 +7,8 @@
 
 #include "constants.h"
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 // The max number of sub regions that can be specified when drawing portions of a texture
@@ -14,29 +16,50 @@
 // The max number of sub regions that can be scaled at the same time
 #define MAX_SCALE_SUB_REGIONS (20)
 
+/**
+ * Basic definition of a color
+ */
+typedef struct Color_t {
+    // Color component values
+    uint8_t r, g, b, a;
+} Color_t;
+
+/**
+ * Text laid out as glyph quads sampling the shared glyph atlas (see render_make_glyph_run). Opaque outside of the renderer
+ */
+typedef struct GlyphRun_t GlyphRun_t;
+
 /**
  * Represents a texture uploaded to the GPU using OpenGL, with some cached information about it
  */
 typedef struct Texture_t {
     // OpenGL texture id
     unsigned int id;
+    // Unique to this texture for as long as the program runs, unlike the OpenGL id which gets reused
+    uint64_t serial;
     // Dimensions in pixels
     int32_t width, height;
     // Optional border radius used when rendering the texture
     float border_radius;
-    // Internal vertex array object and buffer object pre-configured and exclusive to this texture
-    unsigned int vbo, vao;
-    // Cached values used when configuring the above VAO and VBO so we can track when those need to be reconfigured
-    int32_t buf_x, buf_y, buf_w, buf_h;
+    // Whether the texture only has a single (red) channel, used as alpha when drawing it filled with the color below
+    bool single_channel;
+    // Color used to draw single channel textures
+    Color_t color;
+    // Whether the alpha holds a signed distance field (see render_make_sdf_text) instead of plain coverage
+    bool sdf;
+    // When set, the texture has no image of its own (id is 0) and is drawn as the quads of these glyphs instead
+    OWNING MAYBE_NULL GlyphRun_t *glyph_run;
 } Texture_t;
 
 /**
- * Basic definition of a color
+ * Single channel bitmap of some text rasterized on the CPU that was not uploaded to the GPU yet.
+ * Holds either coverage or a signed distance field, depending on how it was made
  */
-typedef struct Color_t {
-    // Color component values
-    uint8_t r, g, b, a;
-} Color_t;
+typedef struct TextBitmap_t {
+    OWNING unsigned char *pixels;
+    int32_t width, height;
+    bool sdf;
+} TextBitmap_t;
 
 /**
  * Basic definition of a bounding box with both (relative) positioning and dimensions.
@@ -60,20 +83,20 @@ typedef struct Bounds_t {
 } Bounds_t;
 
 /**
- * A shadow is basically the same as a texture but with the optional info of being generated separately
- * based on a given texture (usually upon creation) and that can hold additional info such as an offset
- * relative to the parent texture and its own bounds.
- * It's expected of the caller to supply the correct Bounds when drawing the shadow like a regular texture
- * (and drawing it before the texture itself so the effect looks correct) and applying the offset manually.
+ * A drop shadow for a texture. It holds no texture of its own: the shadow is computed from the coverage of the texture it's
+ * drawn for, in the shader, at draw time (see DrawTextureOpts_t.shadow), so the same shadow can be used for any texture.
+ * It should be drawn before the texture itself so the effect looks correct.
  */
 typedef struct Shadow_t {
-    // Texture of the shadow itself
-    OWNING Texture_t *texture;
-    // Bounds of the generated texture. It's likely larger than the texture itself
-    Bounds_t bounds;
-    // Offset relative to the parent texture. Must be applied manually before rendering the shadow.
-    // Applies to both the x and y axis at the same time.
+    // Offset relative to the parent texture, in pixels at its unscaled size. Applies to both the x and y axis at the same time.
     int32_t offset;
+    // Distance in pixels over which the edges of the shadow fade out
+    float softness;
+    // Coverage of the texture blurred ahead of time and grown by the softness on every side (see render_make_blurred_shadow).
+    // Without it, the shadow is computed while drawing
+    OWNING MAYBE_NULL Texture_t *texture;
+    // Size the texture was drawn at when the shadow was made, which the blurred coverage is scaled along with
+    Bounds_t bounds;
 } Shadow_t;
 
 /**
@@ -134,6 +157,43 @@ typedef enum BlendMode_t {
     BLEND_MODE_ERASE
 } BlendMode_t;
 
+/*
+ * Phases of a frame the GPU time is measured for when GPU timing is on (see render_set_gpu_timing)
+ */
+typedef enum RenderPass_t {
+    // Whatever render_clear draws
+    RENDER_PASS_BACKGROUND = 0,
+    // Drop shadows of textures
+    RENDER_PASS_SHADOWS,
+    // Text, either as textures or glyph quads
+    RENDER_PASS_TEXT,
+    // Rounded rectangles
+    RENDER_PASS_RECTS,
+    // Any other texture, like the album art
+    RENDER_PASS_IMAGES,
+    // Anything drawn into a render target, like blurring and generating the reading hints
+    RENDER_PASS_OFFSCREEN,
+    // Copying the finished frame to the window
+    RENDER_PASS_PRESENT,
+    RENDER_PASS_COUNT
+} RenderPass_t;
+
+/*
+ * GPU time spent in one pass, in milliseconds per frame over the last frames measured
+ */
+typedef struct RenderPassTiming_t {
+    const char *name;
+    double last_ms;
+    double average_ms;
+    double max_ms;
+} RenderPassTiming_t;
+
+/**
+ * Receives a frame captured with render_begin_capture: width * height pixels of 4 bytes each (RGBA), with rows going from
+ * the bottom of the frame up. The pixels are only around until it returns
+ */
+typedef void (*RenderCaptureFunc_t)(void *user_data, const uint8_t *pixels, int32_t width, int32_t height);
+
 /*
  * Represents the bounds of a single character inside a bigger string of characters with the specified font
  */
@@ -213,6 +273,9 @@ typedef struct DrawTextureOpts_t {
     WEAK const DrawRegionOptSet_t *draw_regions;
     // Optional set of regions to scale inside the final texture
     WEAK const ScaleRegionOptSet_t *scale_regions;
+    // When set, draws the drop shadow of the texture instead of the texture itself. The shadow is black, so color_mod is
+    // ignored, and so are the draw and scale regions
+    WEAK const Shadow_t *shadow;
 } DrawTextureOpts_t;
 
 /**
@@ -224,8 +287,10 @@ typedef struct DrawTextureOpts_t {
  * It's not recommended (and this applies to the renderer in general, not just this one function) to call any of the render_* functions
  * on threads other than the main one. No synchronization is in place and some of these calls modify internal render state (blend mode,
  * render targets, etc) that will cause weird behavior if called concurrently.
+ * When headless, the window is never shown and frames are presented as fast as they're drawn instead of waiting for vsync.
+ * The hidden window still needs a display to be created on (GLEW loads GL through it), see the README for running without one
  */
-void render_init(void);
+void render_init(bool headless);
 /**
  * Cleans up all resources taken up by the renderer. It's only expected to be ran once in the program lifetime, as the renderer is not
  * meant to be destroyed and reconstructed on each scene/screen change.
@@ -239,15 +304,29 @@ void render_on_window_changed(void);
 /**
  * Clears the framebuffer for drawing, also applying whatever background option is set with the provided colors.
  * Backgrounds can be disabled with BACKGROUND_NONE and setting the color black as the background.
- * Supposed to be called at the start of every frame.
+ * Only clears the clipped area when there's one (see render_set_clip).
+ * Supposed to be called at the start of every frame that draws anything.
  */
 void render_clear(void);
 /**
  * Swaps framebuffers replacing the image being shown in the screen with the one that has been drawn to so far, essentially
- * presenting the image to the screen.
+ * presenting the image to the screen. The clip is lifted.
+ * When nothing was drawn since the last call (render_clear wasn't called) the image on screen is left as is, waiting about a
+ * frame's worth of time for events instead.
  * Supposed to be called at the end of every frame.
  */
 void render_present(void);
+/**
+ * Restricts everything drawn to the screen from then on, render_clear included, to the given area in pixels, or lifts the
+ * restriction when area is NULL. Whatever is outside of it keeps what was drawn there in previous frames.
+ * Render targets aren't affected.
+ */
+void render_set_clip(MAYBE_NULL const Bounds_t *area);
+/**
+ * Whether the screen still holds the whole previous frame, so that only the areas that changed since need to be redrawn (see
+ * render_set_clip). It doesn't after the window or the background changed, or when the background moves on its own.
+ */
+bool render_has_previous_frame(void);
 /**
  * Gets the bounds (usually the x and y will always be zero, so it's mostly the dimensions) of the screen, also considered to be
  * the root container in the UI module.
@@ -278,6 +357,12 @@ void render_set_bg_gradient(Color_t top_color, Color_t bottom_color, BackgroundT
  * For effects that use less than 5 colors (static gradient, dynamic gradient, solid color), the first N colors will be used from this sample
  */
 void render_sample_bg_colors_from_image(const unsigned char *bytes, int length);
+/**
+ * Sets how the animated backgrounds (sands, random, AM-like and cloud) are drawn: at the window size divided by
+ * resolution_divisor, scaled back up to fill it, and only redrawn every update_interval frames, fading from the previous
+ * picture into the new one in between. Values below 1 are taken as 1, which draws them at full size every frame.
+ */
+void render_set_bg_quality(int32_t resolution_divisor, int32_t update_interval);
 /**
  * Set the blend mode to be used when calling render_draw_texture
  */
@@ -286,6 +371,37 @@ void render_set_blend_mode(BlendMode_t mode);
  * Retrieves the current blend mode
  */
 BlendMode_t render_get_blend_mode(void);
+/**
+ * How many GL state changes were skipped so far for setting something to what it already was
+ */
+uint64_t render_get_elided_state_changes(void);
+/**
+ * Turns measuring the GPU time of every pass of a frame (see RenderPass_t) on or off. Passes are timed with queries read
+ * back a frame later so that the CPU never waits on them, but every change of pass ends the current sprite batch.
+ * Returns whether timing is on, which is never the case where timer queries aren't supported (the web build)
+ */
+bool render_set_gpu_timing(bool enabled);
+/**
+ * Fills out with the timings of every pass, indexed by RenderPass_t, over the last frames measured.
+ * Returns how many frames the timings cover, which is 0 if none were measured yet
+ */
+int32_t render_get_gpu_timings(RenderPassTiming_t out[RENDER_PASS_COUNT]);
+/**
+ * Prints the table of render_get_gpu_timings to stdout
+ */
+void render_print_gpu_timings(void);
+/**
+ * Starts capturing every frame presented, drawing them at the given size from then on no matter the size of the window, and
+ * handing each one to func. Frames are read back asynchronously so that drawing never waits on it, and reach func one
+ * present later. Presents that skip drawing capture the unchanged frame again, so there's one frame for every present.
+ * Returns whether capturing started, which it never does where buffers can't be read back (the web build)
+ */
+bool render_begin_capture(int32_t width, int32_t height, RenderCaptureFunc_t func, void *user_data);
+/**
+ * Hands out the last frame still being read back and stops capturing. Frames keep being drawn at the captured size until
+ * the window changes
+ */
+void render_end_capture(void);
 /**
  * Parses a color from a 32-bit unsigned int in ARGB format
  */
@@ -329,6 +445,60 @@ Texture_t *render_make_null(void);
  * in the renderer.
  */
 Texture_t *render_make_text(const char *text, int32_t pixels_size, const Color_t *color, FontType_t font_type);
+/**
+ * Same as render_make_text, but the texture stores a signed distance field of the text instead of its coverage, which is turned
+ * back into sharp edges when drawing. This allows the texture to be drawn scaled up or down without becoming blurry, and the
+ * glyphs are rasterized only once at a fixed reference size no matter the requested size, so remaking the text at another size
+ * (e.g. after a resize) does not need to rasterize anything again.
+ * The resulting texture has the exact same dimensions render_make_text would produce
+ */
+Texture_t *render_make_sdf_text(const char *text, int32_t pixels_size, const Color_t *color, FontType_t font_type);
+/**
+ * Rasterizes the given text into a bitmap without uploading it, as either coverage (like render_make_text) or a distance field
+ * (like render_make_sdf_text). Bitmaps can be combined with render_blit_text_bitmap before being turned into a single texture
+ */
+TextBitmap_t *render_make_text_bitmap(const char *text, int32_t pixels_size, FontType_t font_type, bool sdf);
+/**
+ * Creates a blank text bitmap with the given dimensions, meant to be the destination of render_blit_text_bitmap
+ */
+TextBitmap_t *render_make_empty_text_bitmap(int32_t width, int32_t height, bool sdf);
+/**
+ * Copies the whole src bitmap into dest with its top left corner at the given position, clipping anything outside of dest
+ */
+void render_blit_text_bitmap(TextBitmap_t *dest, const TextBitmap_t *src, int32_t x, int32_t y);
+/**
+ * Uploads the text bitmap into a new single channel texture that is drawn with the given color.
+ * The bitmap is not destroyed and can be freed right after
+ */
+Texture_t *render_make_text_texture(const TextBitmap_t *bitmap, const Color_t *color);
+/**
+ * Frees a text bitmap and its pixels
+ */
+void render_destroy_text_bitmap(TextBitmap_t *bitmap);
+/**
+ * Starts an empty glyph run, an alternative to text bitmaps where nothing is composed into a texture of its own: each glyph is
+ * kept as a quad in a vertex buffer that samples the shared glyph atlas, and the whole run is drawn in a single call.
+ * Draw and scale regions still apply relative to the full size of the text, so the result looks the same as the equivalent
+ * composed bitmap. With sdf set the quads sample the distance field glyphs instead, which stay sharp when drawn scaled
+ */
+GlyphRun_t *render_make_glyph_run(FontType_t font_type, int32_t pixels_size, bool sdf);
+/**
+ * Lays out a single line of text into the run with its top left corner at the given position (in pixels relative to the run),
+ * placing its glyphs in the same spots render_blit_text_bitmap would place them for a bitmap of the same line
+ */
+void render_glyph_run_add_text(GlyphRun_t *run, const char *text, double x, double y);
+/**
+ * Makes a texture of the given size (the size of the laid out text) that draws the run with the given color.
+ * The texture takes ownership of the run, which is freed along with it
+ */
+Texture_t *render_make_glyph_run_texture(GlyphRun_t *run, int32_t width, int32_t height, const Color_t *color);
+/**
+ * Rasterizes every glyph the given texts need at the given size (and kind, coverage or distance field) that is not in the glyph
+ * atlas yet, fanning the rasterization out across the job workers (see jobs.h). Only copying the results into the atlas happens
+ * on the calling thread, so text made out of these texts afterwards, either as bitmaps or glyph runs, only has to lay them out.
+ * Purely an optimization: any glyph not prepared beforehand is still rasterized on its first use
+ */
+void render_prepare_text_glyphs(const char *const *texts, size_t num_texts, int32_t pixels_size, FontType_t font_type, bool sdf);
 /**
  * Creates a texture from raw image data, optionally assigning a border radius to the texture directly (but it's not a feature exclusive
  * to images).
@@ -341,22 +511,26 @@ Texture_t *render_make_image(const unsigned char *bytes, int length, double bord
  */
 Texture_t *render_make_dummy_image(double border_radius_em);
 /**
- * Creates a shadow texture based on the provided texture, which by adding the additional padding so the blur looks better will always
- * be larger than the original texture.
- * The shadow is first created by making a completely black version of the same texture, applying blur to it with some alpha blending
- * and then erasing the part of the original texture that would/will sit on top of the shadow. This is calculated using the provided offset,
- * so if the shadow is later drawn at a different offset, it'll probably show transparent parts.
- * It's probably useful if we have an option to do this erase part or not based on a parameter.
- * The texture itself is not modified but render_draw_texture needs a non-const pointer to the texture because it may need to reconfigure
- * the cached attributes inside the texture (see Texture_t and render_draw_texture for more information).
+ * Creates a drop shadow offset by the given amount of pixels and softened over about the given blur radius, in pixels.
+ * Making it is free: the shadow is only computed for a texture when it's drawn with it (see DrawTextureOpts_t.shadow), which
+ * also cuts it out from under the texture itself unless it's drawn as glyph quads without a distance field.
  */
-Shadow_t *render_make_shadow(Texture_t *texture, const Bounds_t *src_bounds, float blur_radius, int32_t offset);
+Shadow_t *render_make_shadow(float blur_radius, int32_t offset);
 /**
- * Frees all resources associated with a shadow. Does not affect the original texture
+ * Creates a drop shadow like render_make_shadow, except that the texture drawn at the given size is blurred right away into a
+ * texture of its own with render_blur_texture, which then only has to be drawn. Meant for shadows too wide to soften while
+ * drawing, of textures that rarely change, like the album art. Drawing the texture at another size scales the shadow along
+ * with it, so it should be made again when that size changes for good.
+ * The texture isn't cut out from the shadow, so it's only meant for opaque textures
+ */
+Shadow_t *render_make_blurred_shadow(Texture_t *texture, const Bounds_t *size, float blur_radius, int32_t offset);
+/**
+ * Frees all resources associated with a shadow
  */
 void render_destroy_shadow(Shadow_t *shadow);
 /**
- * Frees all resources associated with a texture. Does not destroy any shadows created from it, must be freed separately.
+ * Frees all resources associated with a texture. Its GPU texture is kept in a pool to be reused by the next texture or render
+ * target of the same size and format, up to a limit.
  */
 void render_destroy_texture(Texture_t *texture);
 /**
@@ -377,30 +551,36 @@ const RenderTarget_t *render_make_texture_target(int32_t width, int32_t height);
  */
 Texture_t *render_restore_texture_target(void);
 /**
- * Creates a new texture with blur applied to the given texture, using the blur_radius parameter.
+ * Creates a new texture with blur applied to the given texture, reaching about blur_radius pixels out.
+ * It's a dual filter (Kawase) blur: the texture is downsampled by half a few times and then upsampled back, with a few taps per
+ * pass, so the cost barely grows with the radius and is mostly spent on the first, largest levels.
  */
 Texture_t *render_blur_texture(const Texture_t *source, float blur_radius);
 /**
- * Creates a new texture with blur applied to the given texture, using the blur_radius parameter.
+ * Creates a new texture with blur applied to the given texture, reaching about blur_radius pixels out.
  * The old texture is destroyed so that this virtually "replaces" a texture with is blurred variant without the caller needing to explicitly do so.
  */
 Texture_t *render_blur_texture_replace(Texture_t *source, float blur_radius);
 /**
  * Draws a rounded rect to the screen, using the bounds parameter as both location and dimension parameters, using the given color and border radius.
- * A null texture (created using render_make_null) is needed because a vertex array object and buffer object are pre-computed for the given dimensions
- * for performance and the null texture, even if it doesn't actually point to a texture uploaded to the GPU, helps keep track of this information.
  * This draw function is subject to the currently active render target and behaves the same as render_draw_texture in that regard.
  */
-void render_draw_rounded_rect(const Texture_t *null_tex, const Bounds_t *bounds, const Color_t *color, float border_radius);
+void render_draw_rounded_rect(const Bounds_t *bounds, const Color_t *color, float border_radius);
 /**
  * Draws a texture to the currently active render target (which can be a texture render target, or the framebuffer itself), using the provided options.
- * Bounds specifies the location and size the texture is to be drawn to/as, and upon change in dimensions the pre-computed vertex array object and
- * buffer object can be reconfigured.
- * The texture itself is not changed, but because of the procedure described above, cached values for the dimensions as well as the vertex objects
- * themselves may suffer changes.
+ * Bounds specifies the location and size the texture is to be drawn to/as. Every texture is drawn from the same unit quad placed by the vertex shader,
+ * so moving or resizing it doesn't touch any vertex buffer.
+ * The draw is queued along with the ones before it that sample the same texture (glyph quads all share the glyph atlas) and they all go out together
+ * as a single instanced draw call once something else is drawn, the render target or blend mode change, or the frame is presented.
  * All options are non-destructive and only affect how the texture is drawn to the target, not changing the original data in the texture uploaded to
  * GPU memory.
  */
 void render_draw_texture(Texture_t *texture, const Bounds_t *at, const DrawTextureOpts_t *opts);
+/**
+ * Measures the area of the screen that drawing the texture with render_draw_texture and the same parameters could touch,
+ * including its shadow and scaled regions, with some margin to spare.
+ */
+void render_measure_texture_area(const Texture_t *texture, const Bounds_t *at, const DrawTextureOpts_t *opts,
+                                 Bounds_t *out_area);
 
 #endif // ETSUKO_RENDERER_H
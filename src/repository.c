@@ -6,6 +6,7 @@
 
 #include "error.h"
 #include "str_utils.h"
+#include "trace.h"
 
 #define DEFAULT_BUFFER_CAP (64)
 
@@ -103,6 +104,7 @@ Resource_t *repo_load_resource(const LoadRequest_t *request) {
     if ( str_is_empty(request->relative_path) ) {
         error_abort("Invalid path passed to repo_load_resource");
     }
+    TRACE_BEGIN("repo_load_resource");
 
     Resource_t *resource = calloc(1, sizeof(*resource));
     resource->on_resource_loaded = request->on_resource_loaded;
@@ -161,6 +163,7 @@ Resource_t *repo_load_resource(const LoadRequest_t *request) {
     }
 #endif
 
+    TRACE_END();
     return resource;
 }
 
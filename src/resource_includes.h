@@ -15,6 +15,10 @@ static const char incbin_default_vert_shader[] = {
 #embed "shaders/default.vert.glsl"
     ,'\0'
 };
+static const char incbin_sprite_vert_shader[] = {
+#embed "shaders/sprite.vert.glsl"
+    ,'\0'
+};
 static const char incbin_fullscreen_quad_vert_shader[] = {
 #embed "shaders/fsq.vert.glsl"
     ,'\0'
@@ -2,18 +2,34 @@ in vec2 TexCoord;
 out vec4 frag_color;
 
 uniform sampler2D u_texture;
-uniform vec2 u_direction;
-uniform float u_blur_size;
+// Dual filter (Kawase) blur: downsampling passes read a texture twice the size of the one being drawn to and upsampling
+// passes read one half of its size. Either way, every pass only takes a handful of (bilinear) taps around the texel
+uniform bool u_upsample;
+// Half a texel of the texture being read
+uniform vec2 u_half_texel;
+// How many half texels out the taps are spread
+uniform float u_offset;
 
 void main() {
-    const float weights[5] = float[](0.227027, 0.1945946, 0.1216216, 0.054054, 0.016216);
-    vec2 tex_offset = u_blur_size / vec2(textureSize(u_texture, 0));
+    vec2 spread = u_half_texel * u_offset;
 
-    vec4 result = texture(u_texture, TexCoord) * weights[0];
-    for (int i = 1; i < 5; i++) {
-        result += texture(u_texture, TexCoord + u_direction * tex_offset * float(i)) * weights[i];
-        result += texture(u_texture, TexCoord - u_direction * tex_offset * float(i)) * weights[i];
+    if (!u_upsample) {
+        vec4 sum = texture(u_texture, TexCoord) * 4.0;
+        sum += texture(u_texture, TexCoord - spread);
+        sum += texture(u_texture, TexCoord + spread);
+        sum += texture(u_texture, TexCoord + vec2(spread.x, -spread.y));
+        sum += texture(u_texture, TexCoord - vec2(spread.x, -spread.y));
+        frag_color = sum / 8.0;
+        return;
     }
 
-    frag_color = result;
+    vec4 sum = texture(u_texture, TexCoord + vec2(-spread.x * 2.0, 0.0));
+    sum += texture(u_texture, TexCoord + vec2(-spread.x, spread.y)) * 2.0;
+    sum += texture(u_texture, TexCoord + vec2(0.0, spread.y * 2.0));
+    sum += texture(u_texture, TexCoord + vec2(spread.x, spread.y)) * 2.0;
+    sum += texture(u_texture, TexCoord + vec2(spread.x * 2.0, 0.0));
+    sum += texture(u_texture, TexCoord + vec2(spread.x, -spread.y)) * 2.0;
+    sum += texture(u_texture, TexCoord + vec2(0.0, -spread.y * 2.0));
+    sum += texture(u_texture, TexCoord + vec2(-spread.x, -spread.y)) * 2.0;
+    frag_color = sum / 12.0;
 }
@@ -5,16 +5,13 @@ out vec2 FragPos;
 out vec2 Position;
 
 uniform mat4 u_projection;
-uniform vec4 u_bounds;
-uniform bool u_use_bounds;
+// Quads are drawn from a shared unit quad, placed at u_quad.xy and sized u_quad.zw in pixels
+uniform vec4 u_quad;
 
 void main() {
-    gl_Position = u_projection * vec4(position, 0.0, 1.0);
+    vec2 pos = u_quad.xy + position * u_quad.zw;
+    gl_Position = u_projection * vec4(pos, 0.0, 1.0);
     TexCoord = texCoord;
-    Position = position;
-    if (u_use_bounds) {
-        FragPos = texCoord * u_bounds.zw;
-    } else {
-        FragPos = texCoord;
-    }
+    Position = pos;
+    FragPos = texCoord * u_quad.zw;
 }
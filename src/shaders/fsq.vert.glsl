@@ -3,9 +3,9 @@ layout (location = 1) in vec2 texCoord;
 
 out vec2 fragCoord;
 
-// Full screen quad vert shader
+// Full screen quad vert shader, stretching the shared unit quad over the whole clip space
 void main()
 {
-    gl_Position = vec4(position, 0.0, 1.0);
+    gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
     fragCoord = texCoord;
 }
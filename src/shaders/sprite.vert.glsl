@@ -0,0 +1,53 @@
+// Flags of every sprite, must match the SPRITE_FLAG_* values in renderer.c
+const int FLAG_SHADOW = 8;
+
+// Shared unit quad, stretched over every instance
+layout (location = 0) in vec2 position;
+// Where the sprite goes on screen, in pixels: x, y, width, height
+layout (location = 2) in vec4 a_quad;
+// Rectangle of the texture sampled, in texels: x0, y0, x1, y1
+layout (location = 3) in vec4 a_uv;
+// Rectangle of the whole texture (or text, for glyph quads) this sprite covers, from 0 to 1. Regions are tested against it
+layout (location = 4) in vec4 a_region;
+// Color of single channel textures and the alpha multiplier
+layout (location = 5) in vec4 a_color;
+// Color mod factor, border radius, shadow softness and flags
+layout (location = 6) in vec4 a_params;
+// Shadow offset, how much the shadow grows on every side and the size of the whole texture (or text) being drawn
+layout (location = 7) in vec4 a_extra;
+// First draw region and how many, first erase region and how many, all indices into the regions of texture.frag.glsl
+layout (location = 8) in vec4 a_regionRange;
+
+out vec2 TexCoord;
+out vec2 RegionCoord;
+out vec2 FragPos;
+flat out vec4 Color;
+flat out vec4 Params;
+flat out vec4 Extra;
+flat out int Flags;
+flat out ivec4 RegionRange;
+
+uniform mat4 u_projection;
+uniform vec2 u_textureSize;
+
+void main() {
+    int flags = int(a_params.w + 0.5);
+    vec2 pos = a_quad.xy + position * a_quad.zw;
+    // How far across the sprite this vertex is, which goes past 0 and 1 when the shadow grows it
+    vec2 t = position;
+    if ((flags & FLAG_SHADOW) != 0) {
+        vec2 corner = position * 2.0 - 1.0;
+        pos += corner * a_extra.y + vec2(a_extra.x);
+        t += corner * a_extra.y / a_quad.zw;
+    }
+
+    gl_Position = u_projection * vec4(pos, 0.0, 1.0);
+    TexCoord = mix(a_uv.xy, a_uv.zw, t) / u_textureSize;
+    RegionCoord = mix(a_region.xy, a_region.zw, t);
+    FragPos = RegionCoord * a_extra.zw;
+    Color = a_color;
+    Params = a_params;
+    Extra = a_extra;
+    Flags = flags;
+    RegionRange = ivec4(a_regionRange + 0.5);
+}
@@ -1,62 +1,161 @@
+// Flags of every sprite, must match the SPRITE_FLAG_* values in renderer.c
+const int FLAG_SDF = 1;
+const int FLAG_SINGLE_CHANNEL = 2;
+const int FLAG_GLYPH = 4;
+const int FLAG_SHADOW = 8;
+const int FLAG_SHADOW_ERASE = 16;
+// Must match SPRITE_MAX_REGIONS in renderer.c
+const int MAX_REGIONS = 1024;
+
 in vec2 TexCoord;
+// Position relative to the whole texture (or text, for glyph quads) that the regions are tested against
+in vec2 RegionCoord;
 in vec2 FragPos;
+// Per sprite parameters, see sprite.vert.glsl
+flat in vec4 Color;
+flat in vec4 Params;
+flat in vec4 Extra;
+flat in int Flags;
+flat in ivec4 RegionRange;
 out vec4 FragColor;
 
 uniform sampler2D u_tex;
-uniform float u_alpha;
-uniform float u_borderRadius;
-uniform vec2 u_rectSize;
-uniform float u_colorModFactor;
-uniform int u_num_regions;
-uniform vec4 u_regions[4];
-uniform int u_num_erase_regions;
-uniform vec4 u_erase_regions[20];
+// Draw and erase regions of every sprite in the batch, each sprite reading its own range of them
+layout (std140) uniform SpriteRegions {
+    vec4 u_regions[MAX_REGIONS];
+};
 
-void main() {
-    vec4 texColor = texture(u_tex, TexCoord);
-    float finalAlpha = u_alpha;
-    if (u_borderRadius > 0.0) {
-        // Distance from edges
-        vec2 halfSize = u_rectSize * 0.5;
-        vec2 pos = FragPos - halfSize;
-        // Distance to nearest corner (only outside the inner rectangle)
-        vec2 cornerDist = max(vec2(0.0), abs(pos) - (halfSize - u_borderRadius));
-        float dist = length(cornerDist);
-        if (dist > u_borderRadius) {
-            discard;
+bool inRegion(int index) {
+    vec4 region = u_regions[index];
+    return RegionCoord.x >= region.x && RegionCoord.x <= region.z && RegionCoord.y >= region.y && RegionCoord.y <= region.w;
+}
+
+bool hasFlag(int flag) {
+    return (Flags & flag) != 0;
+}
+
+float coverageAt(vec2 uv) {
+    // Plain quads have nothing outside of the texture, but clamping would repeat its edges
+    if (!hasFlag(FLAG_GLYPH) && (any(lessThan(uv, vec2(0.0))) || any(greaterThan(uv, vec2(1.0))))) {
+        return 0.0;
+    }
+    vec4 color = texture(u_tex, uv);
+    return hasFlag(FLAG_SINGLE_CHANNEL) ? color.r : color.a;
+}
+
+float roundedCornerMask(vec2 fragPos, float borderRadius, float softness) {
+    vec2 halfSize = Extra.zw * 0.5;
+    vec2 cornerDist = max(vec2(0.0), abs(fragPos - halfSize) - (halfSize - borderRadius));
+    return 1.0 - smoothstep(borderRadius - softness, borderRadius + softness, length(cornerDist));
+}
+
+// Whether any of the draw regions of the sprite (all of it, when it has none) covers this fragment and none of its erase regions
+// do
+bool inDrawnRegions() {
+    for (int i = RegionRange.z; i < RegionRange.z + RegionRange.w; i++) {
+        if (inRegion(i)) {
+            return false;
         }
-        finalAlpha = finalAlpha - smoothstep(u_borderRadius - 1.0, u_borderRadius, dist);
     }
-    bool in_region = u_num_regions == 0;
 
-    for (int i = 0; i < u_num_regions; i++) {
-        vec2 region_start = u_regions[i].xy;
-        vec2 region_end = u_regions[i].zw;
+    if (RegionRange.y == 0) {
+        return true;
+    }
+    for (int i = RegionRange.x; i < RegionRange.x + RegionRange.y; i++) {
+        if (inRegion(i)) {
+            return true;
+        }
+    }
+    return false;
+}
 
-        if (TexCoord.x >= region_start.x
-                && TexCoord.x <= region_end.x
-                && TexCoord.y >= region_start.y
-                && TexCoord.y <= region_end.y) {
-            in_region = true;
-            break;
+// The drop shadow of the texture instead of the texture itself: its coverage softened over a few pixels, in black, and (when
+// FLAG_SHADOW_ERASE is set) cut out wherever the texture itself will be drawn on top, offset pixels up and to the left
+vec4 shadowColor() {
+    float borderRadius = Params.y;
+    float softness = Params.z;
+    float offset = Extra.x;
+
+    // How much the texture coordinates change for every pixel on screen, so distances can be given in pixels
+    vec2 uvPerPixelX = dFdx(TexCoord);
+    vec2 uvPerPixelY = dFdy(TexCoord);
+
+    float coverage;
+    if (hasFlag(FLAG_SDF)) {
+        // Distance fields already hold how far every pixel is from the edge, so widening the edge softens it for free
+        float dist = coverageAt(TexCoord);
+        float band = min(0.5, max(fwidth(dist), 0.001) * softness);
+        coverage = smoothstep(0.5 - band, 0.5 + band, dist);
+    } else {
+        // 3x3 tent filter spanning the softness
+        coverage = 0.0;
+        for (int y = -1; y <= 1; y++) {
+            for (int x = -1; x <= 1; x++) {
+                vec2 uv = TexCoord + (float(x) * uvPerPixelX + float(y) * uvPerPixelY) * softness * 0.5;
+                coverage += coverageAt(uv) * float((2 - abs(x)) * (2 - abs(y)));
+            }
+        }
+        coverage /= 16.0;
+    }
+
+    if (borderRadius > 0.0) {
+        coverage *= roundedCornerMask(FragPos, borderRadius, max(softness * 0.5, 1.0));
+    }
+
+    if (hasFlag(FLAG_SHADOW_ERASE)) {
+        vec2 textUv = TexCoord + (uvPerPixelX + uvPerPixelY) * offset;
+        float text = coverageAt(textUv);
+        if (hasFlag(FLAG_SDF)) {
+            float smoothing = max(fwidth(text) * 0.75, 0.001);
+            text = smoothstep(0.5 - smoothing, 0.5 + smoothing, text);
+        }
+        if (borderRadius > 0.0) {
+            text *= roundedCornerMask(FragPos + vec2(offset), borderRadius, 1.0);
         }
+        coverage *= 1.0 - text;
     }
 
-    for (int i = 0; i < u_num_erase_regions; i++) {
-        vec2 region_start = u_erase_regions[i].xy;
-        vec2 region_end = u_erase_regions[i].zw;
+    return vec4(vec3(0.0), coverage * Color.a);
+}
 
-        if (TexCoord.x >= region_start.x
-                && TexCoord.x <= region_end.x
-                && TexCoord.y >= region_start.y
-                && TexCoord.y <= region_end.y) {
+void main() {
+    if (hasFlag(FLAG_SHADOW)) {
+        // Regions are tested against the texture the shadow is cast by, and only after the derivatives were taken
+        vec4 shadow = shadowColor();
+        if (!inDrawnRegions()) {
             discard;
         }
+        FragColor = shadow;
+        return;
     }
 
-    if (!in_region) {
+    vec4 texColor = texture(u_tex, TexCoord);
+    if (hasFlag(FLAG_SINGLE_CHANNEL)) {
+        texColor = vec4(Color.rgb, texColor.r);
+    }
+    if (hasFlag(FLAG_SDF)) {
+        // The edge sits at 0.5, smooth it over about one screen pixel no matter the scale being drawn at
+        // (done before any discard so the derivatives are still well-defined)
+        float smoothing = max(fwidth(texColor.a) * 0.75, 0.001);
+        texColor.a = smoothstep(0.5 - smoothing, 0.5 + smoothing, texColor.a);
+    }
+    float finalAlpha = Color.a;
+    float borderRadius = Params.y;
+    if (borderRadius > 0.0) {
+        // Distance from edges
+        vec2 halfSize = Extra.zw * 0.5;
+        vec2 pos = FragPos - halfSize;
+        // Distance to nearest corner (only outside the inner rectangle)
+        vec2 cornerDist = max(vec2(0.0), abs(pos) - (halfSize - borderRadius));
+        float dist = length(cornerDist);
+        if (dist > borderRadius) {
+            discard;
+        }
+        finalAlpha = finalAlpha - smoothstep(borderRadius - 1.0, borderRadius, dist);
+    }
+    if (!inDrawnRegions()) {
         discard;
     }
 
-    FragColor = vec4(texColor.rgb * u_colorModFactor, texColor.a * finalAlpha);
+    FragColor = vec4(texColor.rgb * Params.x, texColor.a * finalAlpha);
 }
@@ -7,6 +7,7 @@
 #include "constants.h"
 #include "error.h"
 #include "str_utils.h"
+#include "trace.h"
 
 static Song_t *g_song;
 
@@ -332,6 +333,7 @@ static void read_readings(Song_t *song, const char *buffer, const int32_t len, c
 }
 
 void song_load(const char *filename, const char *src, const int src_size) {
+    TRACE_BEGIN("song_load");
     g_song = calloc(1, sizeof(*g_song));
     g_song->lyrics_lines = vec_init();
 
@@ -422,6 +424,7 @@ void song_load(const char *filename, const char *src, const int src_size) {
 
     // Clean up vecs
     vec_destroy(readings_vec);
+    TRACE_END();
 }
 
 Song_t *song_get(void) { return g_song; }
@@ -0,0 +1,213 @@
+#include "trace.h"
+
+#include "constants.h"
+#include "error.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Zones every thread holds on to, after which the oldest ones are overwritten
+#define TRACE_RING_CAPACITY (32768)
+// Zones that can be open at once on a single thread. Deeper ones are still matched up but never recorded
+#define TRACE_MAX_DEPTH (32)
+
+typedef struct TraceZone_t {
+    WEAK const char *name;
+    uint64_t start_ns;
+    uint64_t duration_ns;
+} TraceZone_t;
+
+/**
+ * Zones recorded by a single thread. Only that thread ever writes to it, and others only read zones it already published
+ * through written, so nothing is locked
+ */
+typedef struct TraceThread_t {
+    TraceZone_t zones[TRACE_RING_CAPACITY];
+    // How many zones were written so far, the last TRACE_RING_CAPACITY of which are still in the ring
+    atomic_uint_fast64_t written;
+    // Zones begun that haven't ended yet
+    const char *open_names[TRACE_MAX_DEPTH];
+    uint64_t open_starts[TRACE_MAX_DEPTH];
+    int32_t depth;
+    int32_t id;
+    WEAK const char *name;
+    struct TraceThread_t *next;
+} TraceThread_t;
+
+static atomic_bool g_enabled = false;
+static uint64_t g_start_ns = 0;
+static atomic_int g_next_thread_id = 0;
+// Every thread that recorded something, newest first
+static _Atomic(TraceThread_t *) g_threads = NULL;
+static _Thread_local TraceThread_t *t_thread = NULL;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static TraceThread_t *current_thread(void) {
+    if ( t_thread != NULL ) {
+        return t_thread;
+    }
+
+    TraceThread_t *thread = calloc(1, sizeof(*thread));
+    if ( thread == NULL ) {
+        error_abort("Failed to allocate the trace of a thread");
+    }
+    thread->id = atomic_fetch_add(&g_next_thread_id, 1) + 1;
+
+    thread->next = atomic_load(&g_threads);
+    while ( !atomic_compare_exchange_weak(&g_threads, &thread->next, thread) ) {
+    }
+
+    t_thread = thread;
+    return thread;
+}
+
+void trace_init(const bool enabled) {
+    g_start_ns = now_ns();
+    atomic_store(&g_enabled, enabled);
+    trace_set_thread_name("main");
+}
+
+void trace_finish(void) {
+    atomic_store(&g_enabled, false);
+
+    TraceThread_t *thread = atomic_exchange(&g_threads, NULL);
+    while ( thread != NULL ) {
+        TraceThread_t *next = thread->next;
+        free(thread);
+        thread = next;
+    }
+    t_thread = NULL;
+}
+
+void trace_set_thread_name(const char *name) {
+    if ( !atomic_load_explicit(&g_enabled, memory_order_relaxed) ) {
+        return;
+    }
+    current_thread()->name = name;
+}
+
+void trace_begin(const char *name) {
+    if ( !atomic_load_explicit(&g_enabled, memory_order_relaxed) ) {
+        return;
+    }
+
+    TraceThread_t *thread = current_thread();
+    if ( thread->depth < TRACE_MAX_DEPTH ) {
+        thread->open_names[thread->depth] = name;
+        thread->open_starts[thread->depth] = now_ns();
+    }
+    thread->depth++;
+}
+
+void trace_end(void) {
+    if ( !atomic_load_explicit(&g_enabled, memory_order_relaxed) ) {
+        return;
+    }
+
+    TraceThread_t *thread = current_thread();
+    if ( thread->depth == 0 ) {
+        return;
+    }
+    thread->depth--;
+    if ( thread->depth >= TRACE_MAX_DEPTH ) {
+        return;
+    }
+
+    const uint64_t index = atomic_load_explicit(&thread->written, memory_order_relaxed);
+    TraceZone_t *zone = &thread->zones[index % TRACE_RING_CAPACITY];
+    zone->name = thread->open_names[thread->depth];
+    zone->start_ns = thread->open_starts[thread->depth];
+    zone->duration_ns = now_ns() - zone->start_ns;
+    atomic_store_explicit(&thread->written, index + 1, memory_order_release);
+}
+
+/**
+ * Copies the zones of a thread still in its ring into zones, which must have room for TRACE_RING_CAPACITY of them,
+ * returning how many were copied
+ */
+static uint64_t copy_thread_zones(TraceThread_t *thread, TraceZone_t *zones) {
+    const uint64_t end = atomic_load_explicit(&thread->written, memory_order_acquire);
+    const uint64_t start = end > TRACE_RING_CAPACITY ? end - TRACE_RING_CAPACITY : 0;
+    for ( uint64_t i = start; i < end; i++ ) {
+        zones[i - start] = thread->zones[i % TRACE_RING_CAPACITY];
+    }
+
+    // The thread may have carried on writing over the oldest zones while they were copied, including the one it's writing
+    // right now, so those are left out
+    const uint64_t written_after = atomic_load_explicit(&thread->written, memory_order_acquire);
+    const uint64_t first_intact = written_after >= TRACE_RING_CAPACITY ? written_after - TRACE_RING_CAPACITY + 1 : 0;
+    const uint64_t skipped = first_intact > start ? MIN(first_intact - start, end - start) : 0;
+    for ( uint64_t i = skipped; i < end - start; i++ ) {
+        zones[i - skipped] = zones[i];
+    }
+
+    return end - start - skipped;
+}
+
+bool trace_export(const char *path) {
+    if ( !atomic_load(&g_enabled) ) {
+        return false;
+    }
+
+    FILE *file = fopen(path, "w");
+    if ( file == NULL ) {
+        fprintf(stderr, "Failed to open %s to write the trace\n", path);
+        return false;
+    }
+
+    TraceZone_t *zones = malloc(sizeof(*zones) * TRACE_RING_CAPACITY);
+    if ( zones == NULL ) {
+        error_abort("Failed to allocate zones for the trace");
+    }
+
+    fprintf(file, "{\"traceEvents\":[\n");
+    bool first = true;
+    for ( TraceThread_t *thread = atomic_load(&g_threads); thread != NULL; thread = thread->next ) {
+        if ( thread->name != NULL ) {
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                    first ? "" : ",\n", thread->id, thread->name);
+            first = false;
+        }
+
+        const uint64_t num_zones = copy_thread_zones(thread, zones);
+        for ( uint64_t i = 0; i < num_zones; i++ ) {
+            const TraceZone_t *zone = &zones[i];
+            // Chrome traces are in microseconds
+            const double ts = (double)(zone->start_ns - g_start_ns) / 1000.0;
+            const double dur = (double)zone->duration_ns / 1000.0;
+            fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", first ? "" : ",\n",
+                    zone->name, thread->id, ts, dur);
+            first = false;
+        }
+    }
+    fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+    free(zones);
+    fclose(file);
+    printf("Trace written to %s\n", path);
+    return true;
+}
+
+uint64_t trace_collect_zones(const uint64_t since, const TraceZoneFunc_t func, void *user_data) {
+    if ( !atomic_load_explicit(&g_enabled, memory_order_relaxed) ) {
+        return since;
+    }
+
+    // Only this thread writes to its own ring, so nothing changes under it
+    TraceThread_t *thread = current_thread();
+    const uint64_t end = atomic_load_explicit(&thread->written, memory_order_relaxed);
+    const uint64_t start = end > TRACE_RING_CAPACITY ? MAX(since, end - TRACE_RING_CAPACITY) : since;
+    for ( uint64_t i = start; i < end && func != NULL; i++ ) {
+        const TraceZone_t *zone = &thread->zones[i % TRACE_RING_CAPACITY];
+        func(user_data, zone->name, (double)zone->duration_ns / 1e9);
+    }
+
+    return end;
+}
@@ -0,0 +1,61 @@
+/**
+ * trace.h - Scoped CPU timing zones, recorded per thread and exported as a Chrome trace that can be opened in
+ * chrome://tracing or Perfetto
+ */
+
+#ifndef ETSUKO_TRACE_H
+#define ETSUKO_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Where the trace is written to at exit and with the T key
+#define TRACE_DEFAULT_FILE "etsuko_trace.json"
+
+/**
+ * Marks the start of a zone named after the given string literal, which lasts until the matching TRACE_END on the same thread.
+ * Zones can be nested, and every return path in between has to end the zones it began
+ */
+#define TRACE_BEGIN(name) trace_begin(name)
+/**
+ * Ends the zone begun last on the calling thread
+ */
+#define TRACE_END() trace_end()
+
+/**
+ * Starts recording zones if enabled, otherwise every zone is dropped as soon as it begins.
+ * The calling thread is named the main thread in the trace
+ */
+void trace_init(bool enabled);
+/**
+ * Stops recording and frees everything recorded. Every other thread that recorded zones must have stopped by then
+ */
+void trace_finish(void);
+/**
+ * Names the calling thread in the trace
+ */
+void trace_set_thread_name(const char *name);
+/**
+ * Use TRACE_BEGIN and TRACE_END instead
+ */
+void trace_begin(const char *name);
+void trace_end(void);
+/**
+ * Writes the zones still held by every thread to the file at path as Chrome trace JSON. Every thread keeps only its most
+ * recent zones, so the trace only covers about the last half minute. Must only be called from the main thread.
+ * Returns whether the trace could be written
+ */
+bool trace_export(const char *path);
+
+/**
+ * Function called for a single zone by trace_collect_zones, with its name and how long it lasted in seconds
+ */
+typedef void (*TraceZoneFunc_t)(void *user_data, const char *name, double duration);
+/**
+ * Calls func for every zone the calling thread ended since it had ended the given number of zones, oldest first, and returns
+ * how many it ended so far, to be passed in the next time. Zones already overwritten in the ring are skipped.
+ * func may be NULL to only get the count
+ */
+uint64_t trace_collect_zones(uint64_t since, TraceZoneFunc_t func, void *user_data);
+
+#endif // ETSUKO_TRACE_H
@@ -5,10 +5,12 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "clock.h"
 #include "config.h"
 #include "error.h"
 #include "events.h"
 #include "str_utils.h"
+#include "trace.h"
 
 #ifdef __EMSCRIPTEN__
 #include <emscripten.h>
@@ -18,8 +20,29 @@
 #include "constants.h"
 #include "container_utils.h"
 
+// How long the window has to stay the same size before drawables start being rebuilt
+#define RELAYOUT_DEBOUNCE_SECONDS (0.15)
+// How much of each frame can be spent rebuilding drawables after the window changed
+#define RELAYOUT_FRAME_BUDGET_SECONDS (0.004)
+// How many separate areas of the screen a frame redraws at most, past which the closest ones are merged together
+#define MAX_DAMAGE_AREAS (8)
+// Past this fraction of the screen changing, redrawing all of it at once is cheaper than going area by area
+#define MAX_DAMAGE_SCREEN_FRACTION (0.5)
+
+typedef struct DrawItem_t DrawItem_t;
+
 struct Ui_t {
     Container_t root_container;
+    bool relayout_pending;
+    double relayout_start_time;
+    // Every drawable drawn in the current frame, in order
+    OWNING DrawItem_t *draw_items;
+    size_t num_draw_items, draw_items_capacity;
+    // How many drawables were drawn in the previous frame
+    size_t num_drawn;
+    // Areas of the screen that changed since the previous frame, which never overlap
+    Bounds_t damage[MAX_DAMAGE_AREAS];
+    int32_t num_damage;
 };
 
 Ui_t *ui_init(void) {
@@ -32,6 +55,8 @@ Ui_t *ui_init(void) {
     ui->root_container.child_drawables = vec_init();
     ui->root_container.enabled = true;
 
+    render_set_bg_quality(config_get()->bg_resolution_divisor, config_get()->bg_update_interval);
+    render_set_gpu_timing(config_get()->enable_gpu_timing);
     ui_on_window_changed(ui);
 
     return ui;
@@ -111,30 +136,22 @@ static void update_animations(const Ui_t *ui, const double delta_time) {
     container_update_animations(&ui->root_container, delta_time);
 }
 
-void ui_begin_loop(Ui_t *ui) {
-    if ( events_window_changed() )
-        ui_on_window_changed(ui);
-
-    render_clear();
-    update_animations(ui, events_get_delta_time());
-}
-
 static void draw_dynamic_progressbar(const Drawable_t *drawable, const Bounds_t *base_bounds) {
     const Drawable_ProgressBarData_t *data = drawable->custom_data;
 
     Bounds_t bounds = *base_bounds;
 
     const float border_radius = (float)render_measure_pt_from_em(data->border_radius_em);
-    render_draw_rounded_rect(drawable->texture, &bounds, &data->bg_color, border_radius);
+    render_draw_rounded_rect(&bounds, &data->bg_color, border_radius);
     bounds.w *= MIN(1.0, data->progress);
-    render_draw_rounded_rect(drawable->texture, &bounds, &data->fg_color, border_radius);
+    render_draw_rounded_rect(&bounds, &data->fg_color, border_radius);
 }
 
 static void draw_dynamic_rectangle(const Drawable_t *drawable, const Bounds_t *bounds) {
     const Drawable_RectangleData_t *data = drawable->custom_data;
 
     const float border_radius = (float)render_measure_pt_from_em(data->border_radius_em);
-    render_draw_rounded_rect(drawable->texture, bounds, &data->color, border_radius);
+    render_draw_rounded_rect(bounds, &data->color, border_radius);
 }
 
 static void measure_layout(const Layout_t *layout, const Container_t *parent, Bounds_t *out_bounds) {
@@ -441,21 +458,215 @@ static void apply_animations(const Drawable_t *drawable, AnimationDelta *animati
     }
 }
 
-static void perform_draw(const Drawable_t *drawable, const Bounds_t *base_bounds) {
-    if ( !drawable->enabled || drawable->pending_recompute ) {
+/**
+ * A drawable as it's drawn in the current frame, animations applied
+ */
+struct DrawItem_t {
+    WEAK const Drawable_t *drawable;
+    AnimationDelta delta;
+    // Final bounds on the screen
+    Bounds_t rect;
+    // Area of the screen it covers, shadow and all
+    Bounds_t area;
+};
+
+static uint64_t hash_bytes(uint64_t hash, const void *data, const size_t size) {
+    // FNV-1a
+    const unsigned char *bytes = data;
+    for ( size_t i = 0; i < size; i++ ) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static bool bounds_intersect(const Bounds_t *a, const Bounds_t *b) {
+    return a->x < b->x + b->w && b->x < a->x + a->w && a->y < b->y + b->h && b->y < a->y + a->h;
+}
+
+static void bounds_union(const Bounds_t *a, const Bounds_t *b, Bounds_t *out) {
+    const double x0 = fmin(a->x, b->x), y0 = fmin(a->y, b->y);
+    const double x1 = fmax(a->x + a->w, b->x + b->w), y1 = fmax(a->y + a->h, b->y + b->h);
+    *out = (Bounds_t){.x = x0, .y = y0, .w = x1 - x0, .h = y1 - y0};
+}
+
+/**
+ * Adds an area of the screen to be redrawn. It's merged with any it overlaps, so nothing is drawn twice, and with the one it
+ * grows the least when there's no room left for it
+ */
+static void add_damage(Ui_t *ui, const Bounds_t *area) {
+    const Bounds_t *screen = render_get_viewport();
+    const double x0 = fmax(area->x, 0.0), y0 = fmax(area->y, 0.0);
+    const double x1 = fmin(area->x + area->w, screen->w), y1 = fmin(area->y + area->h, screen->h);
+    if ( x1 <= x0 || y1 <= y0 ) {
         return;
     }
+    Bounds_t damage = {.x = x0, .y = y0, .w = x1 - x0, .h = y1 - y0};
 
-    AnimationDelta delta = {.final_bounds = drawable->bounds,
-                            .final_alpha = drawable->alpha_mod,
-                            .color_mod = drawable->color_mod,
-                            .draw_regions = {0}};
-    delta.draw_regions = drawable->draw_regions;
-    apply_animations(drawable, &delta);
+    int32_t merge_with = -1;
+    double least_growth = INFINITY;
+    for ( int32_t i = 0; i < ui->num_damage; i++ ) {
+        if ( bounds_intersect(&ui->damage[i], &damage) ) {
+            merge_with = i;
+            break;
+        }
+        Bounds_t merged;
+        bounds_union(&ui->damage[i], &damage, &merged);
+        const double growth = merged.w * merged.h - ui->damage[i].w * ui->damage[i].h;
+        if ( growth < least_growth ) {
+            least_growth = growth;
+            merge_with = i;
+        }
+    }
 
-    Bounds_t rect = delta.final_bounds;
-    rect.x += base_bounds->x;
-    rect.y += base_bounds->y;
+    if ( merge_with >= 0 && (ui->num_damage == MAX_DAMAGE_AREAS || bounds_intersect(&ui->damage[merge_with], &damage)) ) {
+        // The merged area might overlap others now, so add it over again
+        bounds_union(&ui->damage[merge_with], &damage, &damage);
+        ui->damage[merge_with] = ui->damage[--ui->num_damage];
+        add_damage(ui, &damage);
+        return;
+    }
+    ui->damage[ui->num_damage++] = damage;
+}
+
+static DrawItem_t *push_draw_item(Ui_t *ui) {
+    if ( ui->num_draw_items == ui->draw_items_capacity ) {
+        const size_t capacity = ui->draw_items_capacity == 0 ? 64 : ui->draw_items_capacity * 2;
+        DrawItem_t *items = realloc(ui->draw_items, capacity * sizeof(*items));
+        if ( items == NULL ) {
+            error_abort("Failed to grow draw items");
+        }
+        ui->draw_items = items;
+        ui->draw_items_capacity = capacity;
+    }
+    return &ui->draw_items[ui->num_draw_items++];
+}
+
+/**
+ * Hashes everything that makes up what the drawable looks like, and measures the area it covers, as drawn by perform_draw
+ */
+static uint64_t measure_draw_item(const DrawItem_t *item, Bounds_t *out_area) {
+    const Drawable_t *drawable = item->drawable;
+    uint64_t hash = hash_bytes(14695981039346656037ull, &drawable->type, sizeof(drawable->type));
+    hash = hash_bytes(hash, &item->rect, sizeof(item->rect));
+
+    if ( drawable->dynamic ) {
+        double border_radius_em;
+        if ( drawable->type == DRAW_TYPE_PROGRESS_BAR ) {
+            const Drawable_ProgressBarData_t *data = drawable->custom_data;
+            hash = hash_bytes(hash, &data->progress, sizeof(data->progress));
+            hash = hash_bytes(hash, &data->fg_color, sizeof(data->fg_color));
+            hash = hash_bytes(hash, &data->bg_color, sizeof(data->bg_color));
+            border_radius_em = data->border_radius_em;
+        } else {
+            const Drawable_RectangleData_t *data = drawable->custom_data;
+            hash = hash_bytes(hash, &data->color, sizeof(data->color));
+            border_radius_em = data->border_radius_em;
+        }
+        hash = hash_bytes(hash, &border_radius_em, sizeof(border_radius_em));
+
+        // Rounded rects are drawn padded by their radius
+        const double padding = render_measure_pt_from_em(border_radius_em) + 1.0;
+        *out_area = (Bounds_t){.x = item->rect.x - padding,
+                               .y = item->rect.y - padding,
+                               .w = item->rect.w + padding * 2.0,
+                               .h = item->rect.h + padding * 2.0};
+        return hash;
+    }
+
+    const AnimationDelta *delta = &item->delta;
+    hash = hash_bytes(hash, &drawable->texture->serial, sizeof(drawable->texture->serial));
+    hash = hash_bytes(hash, &delta->final_alpha, sizeof(delta->final_alpha));
+    hash = hash_bytes(hash, &delta->color_mod, sizeof(delta->color_mod));
+    hash = hash_bytes(hash, &delta->draw_regions.num_regions, sizeof(delta->draw_regions.num_regions));
+    hash = hash_bytes(hash, delta->draw_regions.regions,
+                      (size_t)MAX(0, delta->draw_regions.num_regions) * sizeof(delta->draw_regions.regions[0]));
+    hash = hash_bytes(hash, &delta->scale_regions.num_regions, sizeof(delta->scale_regions.num_regions));
+    hash = hash_bytes(hash, delta->scale_regions.regions,
+                      (size_t)MAX(0, delta->scale_regions.num_regions) * sizeof(delta->scale_regions.regions[0]));
+    hash = hash_bytes(hash, &drawable->draw_underlay, sizeof(drawable->draw_underlay));
+    hash = hash_bytes(hash, &drawable->underlay_alpha, sizeof(drawable->underlay_alpha));
+
+    DrawTextureOpts_t opts = {.scale_regions = &delta->scale_regions};
+    render_measure_texture_area(drawable->texture, &item->rect, &opts, out_area);
+    if ( drawable->shadow != NULL ) {
+        hash = hash_bytes(hash, drawable->shadow, sizeof(*drawable->shadow));
+        hash = hash_bytes(hash, &drawable->alpha_mod, sizeof(drawable->alpha_mod));
+
+        Bounds_t shadow_area;
+        opts.shadow = drawable->shadow;
+        render_measure_texture_area(drawable->texture, &item->rect, &opts, &shadow_area);
+        bounds_union(out_area, &shadow_area, out_area);
+    }
+    return hash;
+}
+
+/**
+ * Adds the drawable to the frame if it's to be drawn, marking the areas of the screen it changed as damaged
+ */
+static void collect_drawable(Ui_t *ui, Drawable_t *drawable, const Bounds_t *base_bounds, bool visible,
+                             size_t *num_still_drawn) {
+    const bool was_drawn = drawable->drawn;
+    if ( was_drawn ) {
+        (*num_still_drawn)++;
+    }
+
+    // Placeholders that currently have no texture (see ui_release_drawable_texture) aren't drawn either
+    visible = visible && drawable->enabled && !drawable->pending_recompute && (drawable->dynamic || drawable->texture != NULL);
+    if ( !visible ) {
+        if ( was_drawn ) {
+            add_damage(ui, &drawable->drawn_area);
+        }
+        drawable->drawn = false;
+        return;
+    }
+
+    DrawItem_t *item = push_draw_item(ui);
+    item->drawable = drawable;
+    item->delta = (AnimationDelta){.final_bounds = drawable->bounds,
+                                   .final_alpha = drawable->alpha_mod,
+                                   .color_mod = drawable->color_mod,
+                                   .draw_regions = {0}};
+    item->delta.draw_regions = drawable->draw_regions;
+    apply_animations(drawable, &item->delta);
+
+    item->rect = item->delta.final_bounds;
+    item->rect.x += base_bounds->x;
+    item->rect.y += base_bounds->y;
+
+    const uint64_t hash = measure_draw_item(item, &item->area);
+    if ( !was_drawn || hash != drawable->drawn_hash || memcmp(&item->area, &drawable->drawn_area, sizeof(item->area)) != 0 ) {
+        if ( was_drawn ) {
+            add_damage(ui, &drawable->drawn_area);
+        }
+        add_damage(ui, &item->area);
+    }
+    drawable->drawn = true;
+    drawable->drawn_hash = hash;
+    drawable->drawn_area = item->area;
+}
+
+static void collect_container(Ui_t *ui, const Container_t *container, Bounds_t base_bounds, bool visible,
+                              size_t *num_still_drawn) {
+    // Disabled containers are still walked, in case what they hold was drawn before and has to be erased now
+    visible = visible && container->enabled;
+
+    base_bounds.x += container->bounds.x;
+    base_bounds.y += container->bounds.y + container->align_content_offset_y + container->viewport_y;
+
+    for ( size_t i = 0; i < container->child_drawables->size; i++ ) {
+        collect_drawable(ui, container->child_drawables->data[i], &base_bounds, visible, num_still_drawn);
+    }
+
+    for ( size_t i = 0; i < container->child_containers->size; i++ ) {
+        collect_container(ui, container->child_containers->data[i], base_bounds, visible, num_still_drawn);
+    }
+}
+
+static void perform_draw(const DrawItem_t *item) {
+    const Drawable_t *drawable = item->drawable;
+    const AnimationDelta *delta = &item->delta;
+    Bounds_t rect = item->rect;
 
     if ( drawable->dynamic ) {
         if ( drawable->type == DRAW_TYPE_PROGRESS_BAR ) {
@@ -469,48 +680,72 @@ static void perform_draw(const Drawable_t *drawable, const Bounds_t *base_bounds
     }
 
     DrawTextureOpts_t opts = {0};
-    opts.scale_regions = &delta.scale_regions;
+    opts.scale_regions = &delta->scale_regions;
     if ( drawable->shadow != NULL ) {
-        Bounds_t shadow_bounds = rect;
-        shadow_bounds.w = drawable->shadow->bounds.w;
-        shadow_bounds.h = drawable->shadow->bounds.h;
         const int32_t max_alpha = drawable->type == DRAW_TYPE_IMAGE ? 50 : 128;
         const uint8_t alpha = MIN(max_alpha, drawable->alpha_mod);
         opts.alpha_mod = alpha;
-        opts.color_mod = 0.f;
-        render_draw_texture(drawable->shadow->texture, &shadow_bounds, &opts);
+        opts.shadow = drawable->shadow;
+        render_draw_texture(drawable->texture, &rect, &opts);
+        opts.shadow = NULL;
     }
 
-    opts.color_mod = delta.color_mod;
+    opts.color_mod = delta->color_mod;
     if ( drawable->draw_underlay ) {
         opts.alpha_mod = drawable->underlay_alpha;
         render_draw_texture(drawable->texture, &rect, &opts);
     }
 
-    opts.alpha_mod = delta.final_alpha;
-    opts.draw_regions = &delta.draw_regions;
+    opts.alpha_mod = delta->final_alpha;
+    opts.draw_regions = &delta->draw_regions;
     render_draw_texture(drawable->texture, &rect, &opts);
 }
 
-static void draw_all_container(const Container_t *container, Bounds_t base_bounds) {
-    if ( !container->enabled )
-        return;
+/**
+ * Clears and draws everything that touches the given area, or the whole screen when it's NULL
+ */
+static void draw_area(const Ui_t *ui, MAYBE_NULL const Bounds_t *area) {
+    render_set_clip(area);
+    render_clear();
+    for ( size_t i = 0; i < ui->num_draw_items; i++ ) {
+        const DrawItem_t *item = &ui->draw_items[i];
+        if ( area == NULL || bounds_intersect(&item->area, area) ) {
+            perform_draw(item);
+        }
+    }
+}
 
-    base_bounds.x += container->bounds.x;
-    base_bounds.y += container->bounds.y + container->align_content_offset_y + container->viewport_y;
+void ui_draw(Ui_t *ui) {
+    TRACE_BEGIN("ui_draw");
+    const Bounds_t bounds = {0};
+    ui->num_draw_items = 0;
+    ui->num_damage = 0;
+    size_t num_still_drawn = 0;
+    collect_container(ui, &ui->root_container, bounds, true, &num_still_drawn);
 
-    for ( size_t i = 0; i < container->child_drawables->size; i++ ) {
-        perform_draw(container->child_drawables->data[i], &base_bounds);
-    }
+    // Drawables destroyed since the previous frame weren't around to say where they were drawn
+    bool full_redraw = num_still_drawn < ui->num_drawn || !render_has_previous_frame() || !config_get()->enable_partial_redraw;
+    ui->num_drawn = ui->num_draw_items;
 
-    for ( size_t i = 0; i < container->child_containers->size; i++ ) {
-        draw_all_container(container->child_containers->data[i], base_bounds);
+    const Bounds_t *screen = render_get_viewport();
+    double damaged = 0.0;
+    for ( int32_t i = 0; i < ui->num_damage; i++ ) {
+        damaged += ui->damage[i].w * ui->damage[i].h;
+    }
+    if ( damaged > screen->w * screen->h * MAX_DAMAGE_SCREEN_FRACTION ) {
+        full_redraw = true;
     }
-}
 
-void ui_draw(const Ui_t *ui) {
-    const Bounds_t bounds = {0};
-    draw_all_container(&ui->root_container, bounds);
+    if ( full_redraw ) {
+        draw_area(ui, NULL);
+    } else {
+        // Nothing drawn at all when nothing changed, so the frame isn't presented either
+        for ( int32_t i = 0; i < ui->num_damage; i++ ) {
+            draw_area(ui, &ui->damage[i]);
+        }
+        render_set_clip(NULL);
+    }
+    TRACE_END();
 }
 
 void ui_end_loop(void) { render_present(); }
@@ -521,6 +756,7 @@ void ui_finish(Ui_t *ui) {
     // Free stored textures and drawables
     ui_destroy_container(ui, &ui->root_container);
     // Cleanup
+    free(ui->draw_items);
     free(ui);
 }
 
@@ -606,6 +842,8 @@ static Drawable_TextData_t *dup_text_data(const Drawable_TextData_t *data) {
     result->line_padding_em = data->line_padding_em;
     result->draw_shadow = data->draw_shadow;
     result->compute_offsets = data->compute_offsets;
+    result->use_sdf = data->use_sdf;
+    result->use_glyph_quads = data->use_glyph_quads;
     return result;
 }
 
@@ -855,10 +1093,68 @@ static void internal_partial_compute_text_offsets(const Drawable_TextData_t *dat
     }
 }
 
-static Drawable_t *internal_make_text(Ui_t *ui, Drawable_t *result, const Drawable_TextData_t *weak_data,
-                                      const Container_t *container, const Layout_t *layout) {
-    Texture_t *final_texture;
+/**
+ * A single visual line of the text, measured and placed relative to the whole text
+ */
+typedef struct TextLine_t {
+    OWNING char *text;
+    int32_t width, height;
+    double x, y;
+} TextLine_t;
 
+/**
+ * Makes the texture of text that has already been laid out, either by composing the bitmaps of its lines on the CPU into a
+ * single channel texture or by laying them out as glyph quads
+ */
+static Texture_t *make_text_texture(const Drawable_TextData_t *data, const Vector_t *lines, const int32_t width,
+                                    const int32_t height) {
+    const int32_t pixels_size = render_measure_pixels_from_em(data->em);
+
+    if ( data->use_glyph_quads ) {
+        GlyphRun_t *glyph_run = render_make_glyph_run(data->font_type, pixels_size, data->use_sdf);
+        for ( size_t i = 0; i < lines->size; i++ ) {
+            const TextLine_t *line = lines->data[i];
+            render_glyph_run_add_text(glyph_run, line->text, line->x, line->y);
+        }
+        return render_make_glyph_run_texture(glyph_run, width, height, &data->color);
+    }
+
+    if ( lines->size == 1 ) {
+        // Nothing to combine
+        const TextLine_t *line = lines->data[0];
+        return data->use_sdf ? render_make_sdf_text(line->text, pixels_size, &data->color, data->font_type)
+                             : render_make_text(line->text, pixels_size, &data->color, data->font_type);
+    }
+
+    // Lines are combined on the CPU so the final texture keeps a single channel
+    TextBitmap_t *final_bitmap = render_make_empty_text_bitmap(width, height, data->use_sdf);
+    for ( size_t i = 0; i < lines->size; i++ ) {
+        const TextLine_t *line = lines->data[i];
+        TextBitmap_t *bitmap = render_make_text_bitmap(line->text, pixels_size, data->font_type, data->use_sdf);
+        render_blit_text_bitmap(final_bitmap, bitmap, (int32_t)line->x, (int32_t)line->y);
+        render_destroy_text_bitmap(bitmap);
+    }
+
+    Texture_t *texture = render_make_text_texture(final_bitmap, &data->color);
+    render_destroy_text_bitmap(final_bitmap);
+    return texture;
+}
+
+static void make_text_shadow(Drawable_t *drawable) {
+    const Drawable_TextData_t *data = drawable->custom_data;
+    const int32_t text_pixels = render_measure_pixels_from_em(data->em);
+    const int32_t offset = (int32_t)MAX(1.f, MIN(10.f, text_pixels * 0.1f));
+    const float blur_radius = (float)data->em; // Make blur radius relative to text size in a shitty way
+    drawable->shadow = render_make_shadow(blur_radius, offset);
+}
+
+/**
+ * Lays out the text (wrapping, alignment and the offsets of every character) and sets the size of the drawable accordingly.
+ * The texture (and shadow) is only made when make_texture is set, otherwise the drawable is left as a placeholder with the
+ * right bounds until ui_restore_drawable_texture is called on it
+ */
+static Drawable_t *internal_make_text(Ui_t *ui, Drawable_t *result, const Drawable_TextData_t *weak_data,
+                                      const Container_t *container, const Layout_t *layout, const bool make_texture) {
     Drawable_TextData_t *data = dup_text_data(weak_data);
     const bool should_compute_offsets =
         data->compute_offsets && (config_get()->enable_dynamic_fill || config_get()->enable_reading_hints);
@@ -872,49 +1168,48 @@ static Drawable_t *internal_make_text(Ui_t *ui, Drawable_t *result, const Drawab
     }
 
     const int32_t line_padding = render_measure_pixels_from_em(data->line_padding_em);
+    const int32_t pixels_size = render_measure_pixels_from_em(data->em);
+
+    Vector_t *lines_vec = vec_init();
+    int32_t max_w = 0, total_h = 0;
 
     const size_t text_size = strlen(data->text);
     if ( data->wrap_enabled && measure_text_wrap_stop(data, container, 0) < (int32_t)text_size ) {
         size_t start = 0;
 
-        Vector_t *textures_vec = vec_init();
-        int32_t max_w = 0, total_h = 0;
-
         do {
             const size_t end = measure_text_wrap_stop(data, container, (int32_t)start);
-            char *line_str = strndup(data->text + start, end - start);
-            const int pixels_size = render_measure_pixels_from_em(data->em);
-            Texture_t *texture = render_make_text(line_str, pixels_size, &data->color, data->font_type);
+            TextLine_t *line = calloc(1, sizeof(*line));
+            if ( line == NULL ) {
+                error_abort("Failed to allocate text line");
+            }
+            line->text = strndup(data->text + start, end - start);
+            render_measure_text_size(line->text, pixels_size, &line->width, &line->height, data->font_type);
 
             if ( should_compute_offsets ) {
-                internal_partial_compute_text_offsets(data, line_str, (int32_t)start);
+                internal_partial_compute_text_offsets(data, line->text, (int32_t)start);
             }
-            free(line_str);
 
-            vec_add(textures_vec, texture);
+            vec_add(lines_vec, line);
 
-            max_w = MAX(max_w, texture->width);
+            max_w = MAX(max_w, line->width);
             if ( total_h != 0 ) {
                 total_h += line_padding;
             }
-            total_h += texture->height;
+            total_h += line->height;
 
             start = end;
         } while ( start < text_size - 1 );
 
-        const RenderTarget_t *target = render_make_texture_target(max_w, total_h);
-        final_texture = target->texture;
-
-        const DrawTextureOpts_t opts = {.color_mod = 1.f, .alpha_mod = 255};
         double x, y = 0;
-        for ( size_t i = 0; i < textures_vec->size; i++ ) {
-            Texture_t *texture = textures_vec->data[i];
+        for ( size_t i = 0; i < lines_vec->size; i++ ) {
+            TextLine_t *line = lines_vec->data[i];
             if ( data->alignment == ALIGN_LEFT ) {
                 x = 0;
             } else if ( data->alignment == ALIGN_RIGHT ) {
-                x = max_w - texture->width;
+                x = max_w - line->width;
             } else if ( data->alignment == ALIGN_CENTER ) {
-                x = max_w / 2.0 - texture->width / 2.0;
+                x = floor(max_w / 2.0 - line->width / 2.0);
             } else {
                 error_abort("Invalid alignment mode");
             }
@@ -925,24 +1220,21 @@ static Drawable_t *internal_make_text(Ui_t *ui, Drawable_t *result, const Drawab
                 info->start_y = y;
             }
 
-            Bounds_t destination = {.x = x, .y = y, .w = (float)texture->width, .h = (float)texture->height};
-            // Disable blend on the texture so it doesn't lose alpha from blending multiple times
-            // when rendering onto a target texture
-            const BlendMode_t blend_mode = render_get_blend_mode();
-            render_set_blend_mode(BLEND_MODE_NONE);
-            render_draw_texture(texture, &destination, &opts);
-            y += texture->height + line_padding;
-
-            render_set_blend_mode(blend_mode);
-
-            render_destroy_texture(texture);
+            line->x = x;
+            line->y = y;
+            y += line->height + line_padding;
         }
-
-        vec_destroy(textures_vec);
-        render_restore_texture_target();
     } else {
-        const int32_t pixels_size = render_measure_pixels_from_em(data->em);
-        final_texture = render_make_text(data->text, pixels_size, &data->color, data->font_type);
+        TextLine_t *line = calloc(1, sizeof(*line));
+        if ( line == NULL ) {
+            error_abort("Failed to allocate text line");
+        }
+        line->text = strdup(data->text);
+        render_measure_text_size(line->text, pixels_size, &line->width, &line->height, data->font_type);
+        vec_add(lines_vec, line);
+
+        max_w = line->width;
+        total_h = line->height;
 
         if ( should_compute_offsets ) {
             internal_partial_compute_text_offsets(data, data->text, 0);
@@ -953,26 +1245,32 @@ static Drawable_t *internal_make_text(Ui_t *ui, Drawable_t *result, const Drawab
         error_abort("Failed to allocate drawable");
     }
 
-    result->bounds.w = final_texture->width;
-    result->bounds.h = final_texture->height;
+    result->bounds.w = max_w;
+    result->bounds.h = total_h;
     result->custom_data = data;
-    result->texture = final_texture;
     result->layout = *layout;
     ui_reposition_drawable(ui, result);
 
-    if ( data->draw_shadow ) {
-        const int32_t text_pixels = render_measure_pixels_from_em(data->em);
-        const int32_t offset = (int32_t)MAX(1.f, MIN(10.f, text_pixels * 0.1f));
-        const float blur_radius = (float)data->em; // Make blur radius relative to text size in a shitty way
-        result->shadow = render_make_shadow(result->texture, &result->bounds, blur_radius, offset);
+    if ( make_texture ) {
+        result->texture = make_text_texture(data, lines_vec, max_w, total_h);
+        if ( data->draw_shadow ) {
+            make_text_shadow(result);
+        }
+    }
+
+    for ( size_t i = 0; i < lines_vec->size; i++ ) {
+        TextLine_t *line = lines_vec->data[i];
+        free(line->text);
+        free(line);
     }
+    vec_destroy(lines_vec);
 
     return result;
 }
 
 Drawable_t *ui_make_text(Ui_t *ui, const Drawable_TextData_t *data, Container_t *container, const Layout_t *layout) {
     Drawable_t *result = make_drawable(container, DRAW_TYPE_TEXT, false);
-    internal_make_text(ui, result, data, container, layout);
+    internal_make_text(ui, result, data, container, layout, !data->defer_texture);
     vec_add(container->child_drawables, result);
     return result;
 }
@@ -982,7 +1280,13 @@ static void apply_shadow_to_image(Drawable_t *drawable) {
         render_destroy_shadow(drawable->shadow);
     }
     const int32_t offset = MAX(1, drawable->bounds.w * 0.01f);
-    drawable->shadow = render_make_shadow(drawable->texture, &drawable->bounds, 1.f, offset);
+    if ( drawable->bounds.w <= 0 || drawable->bounds.h <= 0 ) {
+        drawable->shadow = render_make_shadow(1.f, offset);
+        return;
+    }
+    // Images are opaque and only remade when the layout changes, so their shadows can be blurred once and spread far
+    const float blur_radius = MAX(1.f, drawable->bounds.w * 0.03f);
+    drawable->shadow = render_make_blurred_shadow(drawable->texture, &drawable->bounds, blur_radius, offset);
 }
 
 Drawable_t *ui_make_image(Ui_t *ui, const unsigned char *bytes, const int length, const Drawable_ImageData_t *weak_data,
@@ -1162,15 +1466,15 @@ static Animation_t *find_active_animation(const Drawable_t *drawable, const Anim
 
 void ui_recompute_drawable(Ui_t *ui, Drawable_t *drawable) {
     const Container_t *container = drawable->parent;
+    drawable->pending_relayout = false;
     if ( drawable->type == DRAW_TYPE_TEXT ) {
         void *old_custom_data = drawable->custom_data;
+        // Placeholders (see ui_release_drawable_texture) are only laid out again and stay without a texture
+        const bool had_texture = drawable->texture != NULL;
         // TODO: Maybe we don't need to destroy the texture and realloc/remake it? just make a new opengl texture
         //  and reconfigure the VBA/VAO
-        if ( drawable->texture != NULL ) {
-            render_destroy_texture(drawable->texture);
-            drawable->texture = NULL;
-        }
-        internal_make_text(ui, drawable, old_custom_data, container, &drawable->layout);
+        ui_release_drawable_texture(drawable);
+        internal_make_text(ui, drawable, old_custom_data, container, &drawable->layout, had_texture);
         free_text_data(old_custom_data);
     } else if ( drawable->type == DRAW_TYPE_IMAGE ) {
         const Drawable_ImageData_t *data = drawable->custom_data;
@@ -1188,6 +1492,35 @@ void ui_recompute_drawable(Ui_t *ui, Drawable_t *drawable) {
     }
 }
 
+void ui_release_drawable_texture(Drawable_t *drawable) {
+    if ( drawable->texture != NULL ) {
+        render_destroy_texture(drawable->texture);
+        drawable->texture = NULL;
+    }
+    if ( drawable->shadow != NULL ) {
+        render_destroy_shadow(drawable->shadow);
+        drawable->shadow = NULL;
+    }
+}
+
+void ui_restore_drawable_texture(Ui_t *ui, Drawable_t *drawable) {
+    if ( drawable->texture != NULL ) {
+        return;
+    }
+
+    if ( drawable->type == DRAW_TYPE_TEXT ) {
+        void *old_custom_data = drawable->custom_data;
+        drawable->pending_relayout = false;
+        internal_make_text(ui, drawable, old_custom_data, drawable->parent, &drawable->layout, true);
+        free_text_data(old_custom_data);
+    } else if ( drawable->type == DRAW_TYPE_CUSTOM_TEXTURE ) {
+        // Whoever owns it remakes its texture
+        drawable->pending_recompute = true;
+    } else {
+        error_abort("Only text and custom drawables can have their texture restored");
+    }
+}
+
 void ui_recompute_container(Ui_t *ui, Container_t *container) {
     if ( container->parent != NULL ) {
         measure_layout(&container->layout, container->parent, &container->bounds);
@@ -1223,10 +1556,87 @@ void ui_reposition_container(Ui_t *ui, Container_t *container) {
     }
 }
 
+/**
+ * Keeps the textures made for the old window size but resizes and moves the drawables to match the new one, so they're drawn
+ * stretched until they're rebuilt. Text is scaled by how much the font size changed, everything else by its new layout size
+ */
+static void stretch_container(Ui_t *ui, Container_t *container, const double text_scale) {
+    if ( container->parent != NULL ) {
+        measure_layout(&container->layout, container->parent, &container->bounds);
+        position_layout(ui, &container->layout, container->parent, &container->bounds);
+    }
+
+    for ( size_t i = 0; i < container->child_drawables->size; i++ ) {
+        Drawable_t *drawable = container->child_drawables->data[i];
+        if ( drawable->type == DRAW_TYPE_TEXT ) {
+            drawable->bounds.w *= text_scale;
+            drawable->bounds.h *= text_scale;
+        }
+        ui_reposition_drawable(ui, drawable);
+        drawable->pending_relayout = true;
+    }
+
+    for ( size_t i = 0; i < container->child_containers->size; i++ ) {
+        if ( container->child_containers->data[i] != NULL ) {
+            stretch_container(ui, container->child_containers->data[i], text_scale);
+        }
+    }
+}
+
+/**
+ * Rebuilds the drawables left stale by a window change, in layout order, until the deadline passes.
+ * Returns whether there's nothing left to rebuild
+ */
+static bool relayout_container(Ui_t *ui, Container_t *container, const double deadline) {
+    for ( size_t i = 0; i < container->child_drawables->size; i++ ) {
+        Drawable_t *drawable = container->child_drawables->data[i];
+        if ( !drawable->pending_relayout )
+            continue;
+
+        if ( clock_budget_time() >= deadline )
+            return false;
+        ui_recompute_drawable(ui, drawable);
+    }
+
+    for ( size_t i = 0; i < container->child_containers->size; i++ ) {
+        if ( container->child_containers->data[i] != NULL ) {
+            if ( !relayout_container(ui, container->child_containers->data[i], deadline) )
+                return false;
+        }
+    }
+
+    return true;
+}
+
+void ui_begin_loop(Ui_t *ui) {
+    if ( events_window_changed() ) {
+        const int32_t old_pixels = render_measure_pixels_from_em(100.0);
+        render_on_window_changed();
+        ui->root_container.bounds = *render_get_viewport();
+        stretch_container(ui, &ui->root_container, render_measure_pixels_from_em(100.0) / (double)old_pixels);
+
+        // Wait until it stops changing before rebuilding anything
+        ui->relayout_pending = true;
+        ui->relayout_start_time = clock_frame_time() + RELAYOUT_DEBOUNCE_SECONDS;
+    }
+
+    if ( ui->relayout_pending && clock_frame_time() >= ui->relayout_start_time ) {
+        const double deadline = clock_budget_time() + RELAYOUT_FRAME_BUDGET_SECONDS;
+        if ( relayout_container(ui, &ui->root_container, deadline) ) {
+            // Sizes settled, so make sure everything laid out relative to something else is in the right place
+            ui_reposition_container(ui, &ui->root_container);
+            ui->relayout_pending = false;
+        }
+    }
+
+    update_animations(ui, clock_delta_time());
+}
+
 void ui_on_window_changed(Ui_t *ui) {
     render_on_window_changed();
     ui->root_container.bounds = *render_get_viewport();
     ui_recompute_container(ui, &ui->root_container);
+    ui->relayout_pending = false;
 }
 
 static Animation_EaseTranslationData_t *dup_anim_translate_data(const Animation_EaseTranslationData_t *data) {
@@ -97,6 +97,14 @@ typedef struct Drawable_t {
     uint8_t underlay_alpha;
     bool draw_underlay;
     bool pending_recompute;
+    // Set after the window changes while the drawable still has the texture made for the old size, drawn stretched until the
+    // incremental relayout gets to it (see ui_begin_loop)
+    bool pending_relayout;
+    // Whether it was drawn in the previous frame, what it looked like and the area of the screen it covered, to tell when
+    // that area has to be redrawn (see ui_draw)
+    bool drawn;
+    uint64_t drawn_hash;
+    Bounds_t drawn_area;
 } Drawable_t;
 
 typedef enum AnimationType_t {
@@ -204,6 +212,13 @@ typedef struct Drawable_TextData_t {
     OWNING Vector_t *line_offsets; // of TextOffsetInfo_t
     bool compute_offsets;
     bool increased_line_padding;
+    // Make the text texture as a distance field so it stays sharp when drawn scaled (see render_make_sdf_text)
+    bool use_sdf;
+    // Draw the text as glyph quads sampling the shared glyph atlas instead of baking it into a texture (see render_make_glyph_run)
+    bool use_glyph_quads;
+    // Only lay the text out when making the drawable, which is left as a placeholder of the right size with no texture until
+    // ui_restore_drawable_texture is called on it
+    bool defer_texture;
 } Drawable_TextData_t;
 
 typedef struct Drawable_ImageData_t {
@@ -256,15 +271,24 @@ typedef struct Animation_ScaleRegionData_t {
 // Init and lifetime functions
 Ui_t *ui_init(void);
 void ui_finish(Ui_t *ui);
+/**
+ * Starts a frame. When the window changes, drawables are stretched right away and, once it stops changing for a moment, laid
+ * out again a few at a time each frame so resizing never stalls on rebuilding every texture at once
+ */
 void ui_begin_loop(Ui_t *ui);
 void ui_end_loop(void);
 void ui_load_font(const unsigned char *data, int data_size, FontType_t type);
-void ui_draw(const Ui_t *ui);
+/**
+ * Draws the frame. Only the areas of the screen where drawables changed since the previous frame (they moved, faded, got a new
+ * texture, animated, appeared or went away) are redrawn on top of it, and nothing at all is drawn when none did
+ */
+void ui_draw(Ui_t *ui);
 // Meta helpers
 void ui_set_window_title(const char *title);
 void ui_set_bg_color(uint32_t color);
 void ui_set_bg_gradient(uint32_t primary, uint32_t secondary, BackgroundType_t type);
 void ui_sample_bg_colors_from_image(const unsigned char *bytes, int length);
+// Lays out and rebuilds every drawable for the current window size right away
 void ui_on_window_changed(Ui_t *ui);
 Container_t *ui_root_container(Ui_t *ui);
 void ui_get_drawable_canon_pos(const Drawable_t *drawable, double *x, double *y);
@@ -281,6 +305,17 @@ Drawable_t *ui_make_custom(Ui_t *ui, Container_t *container, const Layout_t *lay
 void ui_recompute_drawable(Ui_t *ui, Drawable_t *drawable);
 void ui_reposition_drawable(Ui_t *ui, Drawable_t *drawable);
 void ui_destroy_drawable(Drawable_t *drawable);
+/**
+ * Frees the texture and shadow of a drawable but keeps everything else, bounds and layout included, so it keeps taking up its
+ * space in the layout while not being drawn. Recomputing the drawable only lays it out again without making a new texture
+ */
+void ui_release_drawable_texture(Drawable_t *drawable);
+/**
+ * Makes the texture (and shadow) of a placeholder text drawable again, see ui_release_drawable_texture and
+ * Drawable_TextData_t.defer_texture. Custom drawables are only flagged as pending a recompute, to be remade by their owner.
+ * Does nothing when the drawable already has a texture
+ */
+void ui_restore_drawable_texture(Ui_t *ui, Drawable_t *drawable);
 double ui_compute_relative_horizontal(Ui_t *ui, double value, Container_t *parent);
 // Change drawable properties
 void ui_drawable_set_alpha(Drawable_t *drawable, int32_t alpha);
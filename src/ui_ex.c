@@ -1,11 +1,13 @@
 #include "ui_ex.h"
 
 #include "audio.h"
+#include "clock.h"
 #include "config.h"
 #include "error.h"
 #include "events.h"
 #include "str_utils.h"
 #include "song.h"
+#include "trace.h"
 
 #include <math.h>
 #include <stdio.h>
@@ -28,6 +30,7 @@
 #define ALPHA_DISTANCE_BASE_CALC (100)
 #define ALPHA_DISTANCE_MIN_VALUE (25)
 #define REGION_ANIMATION_DURATION (0.2)
+#define LINE_TEXT_EM (2.5)
 #define LINE_SCALE_FACTOR_INACTIVE_DURATION (0.2)
 #define SCALE_ANIMATION_DURATION (0.1)
 #define FADE_ANIMATION_DURATION (1.0)
@@ -37,6 +40,10 @@
 #define SCALE_REGION_UP_DURATION (0.15)
 #define SCALE_REGION_DOWN_MIN_DURATION (0.2)
 #define SCALE_REGION_TARGET_SCALE (0.1)
+#define RESIDENT_LINES_BEHIND (3)
+#define RESIDENT_LINES_AHEAD (8)
+#define MAX_RESIDENT_LINES (32)
+#define RESIDENT_VIEWPORT_MARGIN (0.5)
 
 static bool is_line_intermission(const LyricsView_t *view, const int32_t index) {
     const Song_Line_t *line = view->song->lyrics_lines->data[index];
@@ -73,9 +80,15 @@ static void ensure_read_hints_initialized(Ui_t *ui, const LyricsView_t *view) {
         if ( is_line_intermission(view, i) )
             continue;
 
+        // Hints of lines without a texture are made once the line becomes resident again
+        if ( !view->line_resident[i] )
+            continue;
+
         if ( hint->pending_recompute ) {
-            if ( hint->texture != NULL )
+            if ( hint->texture != NULL ) {
                 render_destroy_texture(hint->texture);
+                hint->texture = NULL;
+            }
 
             const Drawable_t *drawable = view->line_drawables->data[i];
             const Drawable_TextData_t *lyric_data = drawable->custom_data;
@@ -83,9 +96,8 @@ static void ensure_read_hints_initialized(Ui_t *ui, const LyricsView_t *view) {
                 continue;
 
             // TODO: Measure actual final size
-            render_make_texture_target(drawable->bounds.w * 1.5, drawable->bounds.h * 1.5);
-            const BlendMode_t blend_mode = render_get_blend_mode();
-            render_set_blend_mode(BLEND_MODE_NONE);
+            TextBitmap_t *hint_bitmap =
+                render_make_empty_text_bitmap((int32_t)(drawable->bounds.w * 1.5), (int32_t)(drawable->bounds.h * 1.5), false);
 
             int pixels = render_measure_pixels_from_em(0.8);
             const Color_t white = {255, 255, 255, 255};
@@ -111,25 +123,15 @@ static void ensure_read_hints_initialized(Ui_t *ui, const LyricsView_t *view) {
                     // overshoots the length of its segment, place it a few pixels to the right of wherever the last hint ended
                     x = MAX(x + 5, character_x + ui_compute_relative_horizontal(ui, 0.01, view->container));
 
-                    Texture_t *text = render_make_text(reading->reading_text, pixels, &white, FONT_UI);
-                    const Bounds_t bounds = {
-                        .x = x,
-                        .y = y,
-                        .w = text->width,
-                        .h = text->height,
-                    };
-                    const DrawTextureOpts_t opts = {
-                        .alpha_mod = 255,
-                        .color_mod = 1.f,
-                    };
-                    render_draw_texture(text, &bounds, &opts);
+                    TextBitmap_t *text = render_make_text_bitmap(reading->reading_text, pixels, FONT_UI, false);
+                    render_blit_text_bitmap(hint_bitmap, text, x, y);
                     x += text->width;
 
-                    render_destroy_texture(text);
+                    render_destroy_text_bitmap(text);
                 }
             }
-            hint->texture = render_restore_texture_target();
-            render_set_blend_mode(blend_mode);
+            hint->texture = render_make_text_texture(hint_bitmap, &white);
+            render_destroy_text_bitmap(hint_bitmap);
             reposition_hint_for_line(ui, view, i);
 
             hint->pending_recompute = false;
@@ -147,6 +149,106 @@ static float get_active_line_scale() {
     return config_get()->enlarge_active_line ? LINE_SCALE_FACTOR_ACTIVE : LINE_SCALE_FACTOR_INACTIVE;
 }
 
+/**
+ * Rasterizes the glyphs of every line at once across all cores before the lines are made one by one
+ */
+static void prepare_lyrics_glyphs(const Song_t *song) {
+    const char **texts = malloc((song->lyrics_lines->size + 1) * sizeof(*texts));
+    if ( texts == NULL ) {
+        error_abort("Failed to allocate lyrics texts");
+    }
+
+    size_t num_texts = 0;
+    for ( size_t i = 0; i < song->lyrics_lines->size; i++ ) {
+        const Song_Line_t *line = song->lyrics_lines->data[i];
+        if ( line->full_text != NULL ) {
+            texts[num_texts++] = line->full_text;
+        }
+    }
+    // Shown in place of empty lines during intermissions
+    texts[num_texts++] = "...";
+
+    const int32_t pixels_size = render_measure_pixels_from_em(LINE_TEXT_EM);
+    render_prepare_text_glyphs(texts, num_texts, pixels_size, FONT_LYRICS, config_get()->enable_sdf_lyrics);
+    free(texts);
+}
+
+static bool is_line_wanted_resident(const LyricsView_t *view, const int32_t index, const double viewport_h) {
+    const int32_t active = MAX(0, view->current_active_index);
+    if ( index >= active - RESIDENT_LINES_BEHIND && index <= active + RESIDENT_LINES_AHEAD ) {
+        return true;
+    }
+
+    // Also keep whatever the user scrolled into view (plus some margin so the next few lines are ready)
+    const Drawable_t *drawable = view->line_drawables->data[index];
+    double y;
+    ui_get_drawable_canon_pos(drawable, NULL, &y);
+    const double margin = viewport_h * RESIDENT_VIEWPORT_MARGIN;
+    return y + drawable->bounds.h >= -margin && y <= viewport_h + margin;
+}
+
+static void make_line_resident(Ui_t *ui, LyricsView_t *view, const int32_t index) {
+    ui_restore_drawable_texture(ui, view->line_drawables->data[index]);
+    if ( index < (int32_t)view->line_read_hints->size ) {
+        Drawable_t *hint = view->line_read_hints->data[index];
+        hint->pending_recompute = true;
+    }
+
+    view->line_resident[index] = true;
+    view->num_resident_lines++;
+}
+
+static void evict_line(LyricsView_t *view, const int32_t index) {
+    ui_release_drawable_texture(view->line_drawables->data[index]);
+    if ( index < (int32_t)view->line_read_hints->size ) {
+        Drawable_t *hint = view->line_read_hints->data[index];
+        if ( hint->texture != NULL ) {
+            render_destroy_texture(hint->texture);
+            hint->texture = NULL;
+        }
+        hint->pending_recompute = true;
+    }
+
+    view->line_resident[index] = false;
+    view->num_resident_lines--;
+}
+
+/**
+ * Makes sure the lines around the active one and the ones on screen have a texture, and evicts the least recently wanted
+ * ones when there are more than MAX_RESIDENT_LINES of them
+ */
+static void update_line_residency(Ui_t *ui, LyricsView_t *view) {
+    const int32_t num_lines = (int32_t)view->line_drawables->size;
+    const double viewport_h = render_get_viewport()->h;
+    const uint64_t tick = ++view->residency_tick;
+
+    for ( int32_t i = 0; i < num_lines; i++ ) {
+        if ( !is_line_wanted_resident(view, i, viewport_h) )
+            continue;
+
+        if ( !view->line_resident[i] ) {
+            make_line_resident(ui, view, i);
+        }
+        view->line_last_used[i] = tick;
+    }
+
+    while ( view->num_resident_lines > MAX_RESIDENT_LINES ) {
+        int32_t lru = -1;
+        for ( int32_t i = 0; i < num_lines; i++ ) {
+            if ( view->line_resident[i] && view->line_last_used[i] != tick &&
+                 (lru < 0 || view->line_last_used[i] < view->line_last_used[lru]) ) {
+                lru = i;
+            }
+        }
+        if ( lru < 0 )
+            break; // Everything resident is also wanted right now
+        evict_line(view, lru);
+    }
+
+    // Also picks up the hints of lines that were just laid out again after the window changed
+    ensure_read_hints_initialized(ui, view);
+}
+
 LyricsView_t *ui_ex_make_lyrics_view(Ui_t *ui, Container_t *parent, const Song_t *song) {
     if ( parent == NULL ) {
         error_abort("Parent container is NULL");
@@ -182,6 +284,8 @@ LyricsView_t *ui_ex_make_lyrics_view(Ui_t *ui, Container_t *parent, const Song_t
         base_offset_x = LINE_RIGHT_ALIGN_PADDING;
     }
 
+    prepare_lyrics_glyphs(song);
+
     Drawable_t *prev = NULL;
     for ( size_t i = 0; i < song->lyrics_lines->size; i++ ) {
         const Song_Line_t *line = song->lyrics_lines->data[i];
@@ -223,14 +327,17 @@ LyricsView_t *ui_ex_make_lyrics_view(Ui_t *ui, Container_t *parent, const Song_t
         const double line_padding = should_generate_reading_hints ? TEXT_LINE_PADDING_WITH_READINGS : 0;
         Drawable_TextData_t data = {.text = line_text,
                                     .font_type = FONT_LYRICS,
-                                    .em = 2.5,
+                                    .em = LINE_TEXT_EM,
                                     .wrap_enabled = true,
                                     .wrap_width_threshold = 0.85,
                                     .color = color,
                                     .line_padding_em = line_padding,
                                     .alignment = alignment,
                                     .draw_shadow = config_get()->draw_lyric_shadow,
-                                    .compute_offsets = song->has_sub_timings || song->has_reading_info};
+                                    .compute_offsets = song->has_sub_timings || song->has_reading_info,
+                                    .use_sdf = config_get()->enable_sdf_lyrics,
+                                    .use_glyph_quads = config_get()->enable_glyph_quad_lyrics,
+                                    .defer_texture = true};
         const double vertical_padding = get_line_vertical_padding(view);
         Layout_t layout = {
             .offset_y = vertical_padding,
@@ -318,7 +425,7 @@ LyricsView_t *ui_ex_make_lyrics_view(Ui_t *ui, Container_t *parent, const Song_t
                                &(Animation_EaseTranslationData_t){.duration = 0.3, .ease_func = ANIM_EASE_OUT_CUBIC});
     }
 
-    ensure_read_hints_initialized(ui, view);
+    update_line_residency(ui, view);
 
     return view;
 }
@@ -352,6 +459,7 @@ static int32_t calculate_distance(const LyricsView_t *view, const int32_t index,
 
 static void calculate_sub_region_for_active_line(LyricsView_t *view, Drawable_t *drawable, const Song_t *song,
                                                  const Song_Line_t *line) {
+    TRACE_BEGIN("calculate_sub_region_for_active_line");
     // A slight variation that highlights the entire portion of the segment
     // Mainly intended when the timing is done per-syllable
     const Drawable_TextData_t *text_data = drawable->custom_data;
@@ -360,7 +468,7 @@ static void calculate_sub_region_for_active_line(LyricsView_t *view, Drawable_t
     draw_regions.num_regions = (int32_t)text_data->line_offsets->size;
 
     double last_segment_remaining = 0.0;
-    const double audio_elapsed = audio_elapsed_time() + song->time_offset;
+    const double audio_elapsed = clock_song_time() + song->time_offset;
     int32_t timing_offset_start = 0;
 
     // Check for any visited segments that are now in the future (e.g. user seeked backwards)
@@ -466,6 +574,7 @@ static void calculate_sub_region_for_active_line(LyricsView_t *view, Drawable_t
     }
     const double fill_duration = MAX(0.0, last_segment_remaining);
     ui_drawable_set_draw_region_dur(drawable, &draw_regions, fill_duration);
+    TRACE_END();
 }
 
 static void set_line_active(Ui_t *ui, LyricsView_t *view, const int32_t index, const int32_t prev_active) {
@@ -712,6 +821,7 @@ void ui_ex_lyrics_view_loop(Ui_t *ui, LyricsView_t *view) {
     }
     if ( view->container->enabled == false )
         return;
+    TRACE_BEGIN("ui_ex_lyrics_view_loop");
 
     check_user_input(view);
 
@@ -719,7 +829,7 @@ void ui_ex_lyrics_view_loop(Ui_t *ui, LyricsView_t *view) {
 
     int32_t prev_active = -1;
     const double offset = view->song->time_offset;
-    const double elapsed_time = audio_elapsed_time() + offset;
+    const double elapsed_time = clock_song_time() + offset;
 
     for ( int32_t i = 0; i < (int32_t)view->song->lyrics_lines->size; i++ ) {
         const Song_Line_t *line = view->song->lyrics_lines->data[i];
@@ -761,7 +871,10 @@ void ui_ex_lyrics_view_loop(Ui_t *ui, LyricsView_t *view) {
             ui_reposition_drawable(ui, view->credits_content);
     }
 
+    update_line_residency(ui, view);
+
     view->prev_viewport_y = view->container->viewport_y;
+    TRACE_END();
 }
 
 void ui_ex_lyrics_view_on_screen_change(Ui_t *ui, LyricsView_t *view) { ensure_read_hints_initialized(ui, view); }
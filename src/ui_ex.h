@@ -33,6 +33,11 @@ typedef struct etsuko_LyricsView_t {
     bool layout_dirty;
     OWNING Drawable_t *credit_separator, *credits_prefix, *credits_content;
     uint32_t active_line_segment_visited[MAX_TIMINGS_PER_LINE];
+    // Lines keep their bounds at all times but only a window of them around the active line and the viewport owns a texture
+    bool line_resident[MAX_SONG_LINES];
+    uint64_t line_last_used[MAX_SONG_LINES];
+    uint64_t residency_tick;
+    int32_t num_resident_lines;
 } LyricsView_t;
 
 LyricsView_t *ui_ex_make_lyrics_view(Ui_t *ui, Container_t *parent, const Song_t *song);